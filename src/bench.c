@@ -0,0 +1,392 @@
+#include <stdio.h>
+#include <stdlib.h> /* srand, rand */
+#include <time.h> /* clock_gettime */
+#include <fcntl.h> /* open */
+#include <unistd.h> /* close */
+#include "engine.h"
+#include "rows.h"
+#include "render.h"
+
+/* Microbenchmarks of the engine and the renderer. Every case is run
+ * bench_runs times and the fastest run is reported, the results go to stdout
+ * as JSON so that runs of two revisions can be diffed.
+ */
+
+enum { bench_runs = 5, bench_seed = 12345, bench_ops = 2000000 };
+
+enum { screen_width = 80, screen_height = 24 };
+
+static int first_result = 1;
+static volatile int sink;
+
+static double now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void report(const char *name, const char *param, int value,
+				   long ops, double ns, double bytes)
+{
+	printf("%s\n    {\"name\": \"%s\"", first_result ? "" : ",", name);
+	if (param)
+		printf(", \"%s\": %d", param, value);
+	printf(", \"ops\": %ld, \"ns_per_op\": %.3f", ops, ns / ops);
+	if (bytes >= 0)
+		printf(", \"bytes_per_op\": %.1f", bytes);
+	printf("}");
+	first_result = 0;
+}
+
+/* bottom rows filled at random with a hole or two in each */
+static void make_board(struct engine_t *e, int rows)
+{
+	int x, y;
+
+	engine_init(e, bench_seed, randomizer_uniform);
+	for (y = board_height - rows; y < board_height; y++) {
+		for (x = 0; x < board_width; x++) {
+			if (rand() % 4 == 0)
+				continue;
+			e->rows[y] |= 1u << x;
+			engine_color(e, x, y) = (unsigned char)(rand() % 7 + 1);
+		}
+		if (e->rows[y] == full_row) {
+			e->rows[y] &= ~1u;
+			engine_color(e, 0, y) = 0;
+		}
+	}
+	engine_rebuild(e);
+}
+
+static void bench_collision()
+{
+	struct engine_t e;
+	int w, x, y, run, hits;
+	long ops;
+	double t, best;
+
+	make_board(&e, 8);
+	for (w = 0; w < tetromino_count; w++) {
+		best = 0;
+		ops = 0;
+		for (run = 0; run < bench_runs; run++) {
+			hits = 0;
+			ops = 0;
+			t = now_ns();
+			while (ops < bench_ops)
+				for (y = 0; y < board_height; y++)
+					for (x = -2; x < board_width; x++, ops++)
+						hits += engine_collides(&e, w, x, y);
+			t = now_ns() - t;
+			sink += hits;
+			if (!run || t < best)
+				best = t;
+		}
+		report("is_collision", "orientation", w, ops, best, -1);
+	}
+}
+
+/* the I-tetromino stands in the 4 bottom rows, lines of them are full */
+static void make_clear_board(struct engine_t *e, int lines)
+{
+	int x, y;
+
+	make_board(e, 10);
+	e->curr.which = 4;
+	e->curr.x = 3;
+	e->curr.y = board_height - 4;
+	for (y = board_height - 4; y < board_height; y++) {
+		for (x = 0; x < board_width; x++) {
+			e->rows[y] |= 1u << x;
+			engine_color(e, x, y) = (unsigned char)(x % 7 + 1);
+		}
+		if (y - (board_height - 4) >= lines) {
+			e->rows[y] &= ~(1u << 7);
+			engine_color(e, 7, y) = 0;
+		}
+	}
+	engine_rebuild(e);
+}
+
+static void bench_copy()
+{
+	struct engine_t tmpl, e;
+	int run;
+	long i, ops = bench_ops;
+	double t, best = 0;
+
+	make_clear_board(&tmpl, 0);
+	for (run = 0; run < bench_runs; run++) {
+		t = now_ns();
+		for (i = 0; i < ops; i++) {
+			engine_copy(&e, &tmpl);
+			sink += e.score;
+		}
+		t = now_ns() - t;
+		if (!run || t < best)
+			best = t;
+	}
+	report("state_copy", NULL, 0, ops, best, -1);
+}
+
+/* each op restores the board first, compare with state_copy */
+static void bench_clear_lines()
+{
+	struct engine_t tmpl, e;
+	int lines, run;
+	long i, ops = bench_ops;
+	double t, best;
+
+	for (lines = 0; lines <= 4; lines++) {
+		make_clear_board(&tmpl, lines);
+		best = 0;
+		for (run = 0; run < bench_runs; run++) {
+			t = now_ns();
+			for (i = 0; i < ops; i++) {
+				engine_copy(&e, &tmpl);
+				sink += engine_clear_lines(&e);
+			}
+			t = now_ns() - t;
+			if (!run || t < best)
+				best = t;
+		}
+		report("remove_full_lines", "lines", lines, ops, best, -1);
+	}
+}
+
+static void bench_lock()
+{
+	struct engine_t tmpl, e;
+	int run;
+	long i, ops = bench_ops;
+	double t, best = 0;
+
+	make_board(&tmpl, 8);
+	tmpl.curr.which = 16;
+	tmpl.curr.x = 5;
+	tmpl.curr.y = 5;
+	for (run = 0; run < bench_runs; run++) {
+		t = now_ns();
+		for (i = 0; i < ops; i++) {
+			engine_copy(&e, &tmpl);
+			engine_lock(&e);
+			sink += e.rows[5];
+		}
+		t = now_ns() - t;
+		if (!run || t < best)
+			best = t;
+	}
+	report("lock_tetromino", NULL, 0, ops, best, -1);
+}
+
+static void bench_spawn()
+{
+	struct engine_t e;
+	int run, r;
+	long i, ops = bench_ops;
+	double t, best;
+
+	for (r = 0; r < randomizer_count; r++) {
+		engine_init(&e, bench_seed, (enum randomizer_t)r);
+		best = 0;
+		for (run = 0; run < bench_runs; run++) {
+			t = now_ns();
+			for (i = 0; i < ops; i++)
+				sink += engine_spawn(&e);
+			t = now_ns() - t;
+			if (!run || t < best)
+				best = t;
+		}
+		report("new_tetromino", "randomizer", r, ops, best, -1);
+	}
+}
+
+static void draw_board(struct render_t *r, const struct engine_t *e)
+{
+	int i, x, y, x0 = 27, y0 = 3;
+	const struct tetromino_t *t = &tetromines[e->curr.which];
+
+	for (y = 0; y < board_height; y++) {
+		render_text(r, x0, y0+y, "|", font_white, default_back);
+		render_text(r, x0 + board_width*2 + 1, y0+y, "|",
+					font_white, default_back);
+		for (x = 0; x < board_width; x++) {
+			if (engine_color(e, x, y))
+				render_text(r, x0+1 + x*2, y0+y, "  ", default_font,
+							back_red + engine_color(e, x, y)-1);
+			else
+				render_text(r, x0+1 + x*2, y0+y, "..",
+							font_white, default_back);
+		}
+	}
+	for (i = 0; i < 4; i++)
+		render_text(r, x0+1 + (t->blocks[i].x + e->curr.x)*2,
+					y0 + t->blocks[i].y + e->curr.y, "  ", default_font,
+					back_red + piece_kind(e->curr.which));
+}
+
+/* random inputs, a new game after every game over; the standard width runs
+ * the code with the board size folded in, the others the generic code
+ */
+static void bench_step()
+{
+	static const int widths[] = {
+		board_width, board_width+1, 64, board_max_width
+	};
+	static const enum engine_input inputs[] = {
+		input_left, input_right, input_rotate, input_down, input_tick,
+		input_drop
+	};
+	struct engine_any_t room;
+	struct engine_t *e = &room.e;
+	int k, run;
+	long i, ops = bench_ops;
+	double t, best;
+
+	for (k = 0; k < (int)(sizeof(widths) / sizeof(widths[0])); k++) {
+		best = 0;
+		for (run = 0; run < bench_runs; run++) {
+			srand(bench_seed);
+			engine_init_size(e, bench_seed, randomizer_uniform, widths[k],
+							 board_height);
+			t = now_ns();
+			for (i = 0; i < ops; i++) {
+				if (e->game_over)
+					engine_init_size(e, bench_seed + (unsigned int)i,
+									 randomizer_uniform, widths[k],
+									 board_height);
+				sink += engine_step(e, inputs[rand() % 6]);
+			}
+			t = now_ns() - t;
+			if (!run || t < best)
+				best = t;
+		}
+		report("engine_step", "width", widths[k], ops, best, -1);
+	}
+}
+
+/* For every kernel the CPU runs: rows full but for the last cell, which
+ * rows_full() reads to the end, then the holes of a board of
+ * board_max_height random rows. bytes_per_op is the row words read.
+ */
+static void bench_rows()
+{
+	static const int widths[] = { 32, 64, 128, 256 };
+	row_t rows[board_max_height * row_words(board_max_width)];
+	row_t almost[board_max_height * row_words(board_max_width)];
+	char name[32];
+	int isa, k, y, w, words, run;
+	long i, ops;
+	double t, best;
+
+	for (i = 0; i < (long)(sizeof(rows) / sizeof(rows[0])); i++)
+		rows[i] = (row_t)rand() | (row_t)rand() << 16;
+	for (isa = 0; isa < row_isa_count; isa++) {
+		if (!row_isa_supported(isa))
+			continue;
+		for (k = 0; k < (int)(sizeof(widths) / sizeof(widths[0])); k++) {
+			words = row_words(widths[k]);
+			for (y = 0; y < board_max_height; y++) {
+				for (w = 0; w < words; w++)
+					almost[y*words + w] = ~(row_t)0;
+				almost[y*words + words-1] &= ~(1u << (widths[k]-1) % 32);
+			}
+
+			ops = bench_ops / 10;
+			best = 0;
+			for (run = 0; run < bench_runs; run++) {
+				t = now_ns();
+				for (i = 0; i < ops; i++)
+					for (y = 0; y < board_max_height; y++)
+						sink += rows_full_isa(isa, almost + y*words,
+											  widths[k]);
+				t = now_ns() - t;
+				if (!run || t < best)
+					best = t;
+			}
+			sprintf(name, "row_full_%s", row_isa_names[isa]);
+			report(name, "width", widths[k], ops * board_max_height, best,
+				   words * sizeof(row_t));
+
+			ops = bench_ops / 10;
+			best = 0;
+			for (run = 0; run < bench_runs; run++) {
+				t = now_ns();
+				for (i = 0; i < ops; i++)
+					sink += rows_holes_isa(isa, rows, words, board_max_height);
+				t = now_ns() - t;
+				if (!run || t < best)
+					best = t;
+			}
+			sprintf(name, "row_holes_%s", row_isa_names[isa]);
+			report(name, "width", widths[k], ops, best,
+				   board_max_height * words * sizeof(row_t));
+		}
+	}
+}
+
+/* frames go to /dev/null: a full repaint, and a tetromino moving sideways */
+static void bench_render()
+{
+	struct engine_t e;
+	struct render_t r;
+	int fd, run, full;
+	long i, ops = bench_ops / 100;
+	double t, best, bytes;
+
+	fd = open("/dev/null", O_WRONLY);
+	if (fd == -1 || !render_init(&r, fd, screen_width, screen_height)) {
+		fprintf(stderr, "bench: cannot set up the renderer\n");
+		exit(1);
+	}
+
+	make_board(&e, 8);
+	e.curr.which = 16;
+	e.curr.y = 3;
+	for (full = 1; full >= 0; full--) {
+		best = 0;
+		bytes = 0;
+		for (run = 0; run < bench_runs; run++) {
+			r.frames = r.bytes = 0;
+			t = now_ns();
+			for (i = 0; i < ops; i++) {
+				e.curr.x = 3 + i % 2;
+				if (full)
+					render_invalidate(&r);
+				render_clear(&r);
+				draw_board(&r, &e);
+				render_flush(&r);
+			}
+			t = now_ns() - t;
+			if (!run || t < best)
+				best = t;
+			bytes = (double)r.bytes / ops;
+		}
+		report("render_frame", "full", full, ops, best, bytes);
+	}
+
+	render_free(&r);
+	close(fd);
+}
+
+int main()
+{
+	srand(bench_seed);
+
+	printf("{\n  \"seed\": %d,\n  \"runs\": %d,\n  \"benchmarks\": [",
+		   bench_seed, bench_runs);
+	bench_collision();
+	bench_copy();
+	bench_clear_lines();
+	bench_lock();
+	bench_spawn();
+	bench_step();
+	bench_rows();
+	bench_render();
+	printf("\n  ]\n}\n");
+
+	return 0;
+}
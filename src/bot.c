@@ -0,0 +1,422 @@
+#include <stdlib.h> /* malloc, qsort */
+#include <string.h> /* memset, memcpy */
+#include <stdint.h> /* uint64_t */
+#if !FOR_WINDOWS
+#include <pthread.h>
+#endif
+#include "engine.h"
+#include "piece_tables.h"
+#include "bot.h"
+
+/* A search state is an orientation, a column and a row of the piece, the
+ * column starts at state_min_x because blocks need not start at x = 0.
+ */
+enum { state_min_x = -3, state_columns = board_width - state_min_x,
+	   state_count = 4 * state_columns * board_height };
+
+/* more than any board has, the rest would not be searched */
+enum { max_landings = 256 };
+
+enum { move_rotate, move_left, move_right, move_down };
+
+#define lost_score (-1e30)
+
+const struct bot_weights_t bot_default_weights = {
+	-0.51, 0.76, -0.36, -0.18, -0.05
+};
+
+/* breadth first over the moves, so paths are the shortest */
+struct search_t {
+	short parent[state_count];
+	unsigned char move[state_count];
+	unsigned char depth[state_count];
+	unsigned char seen[state_count];
+	short queue[state_count];
+	short landing[max_landings];
+	int count;
+};
+
+struct bot_node_t {
+	int state;
+	int lines;
+	double score;		/* of the board after the placement */
+	double best;		/* of the best board after the next piece too */
+	struct engine_t *board;		/* in bot->boards */
+};
+
+/* a game on the standard board is its first engine_standard_size bytes,
+ * the boards of the nodes take no more
+ */
+enum { board_stride = (engine_standard_size + sizeof(long)-1)
+	   / sizeof(long) * sizeof(long) };
+
+struct job_t {
+	const struct bot_t *bot;
+	struct bot_node_t *nodes;
+	int count;
+	volatile int next;		/* the node the next thread takes */
+};
+
+static int state_of(int which, int x, int y)
+{
+	return ((which % 4) * state_columns + x - state_min_x) * board_height + y;
+}
+
+static struct piece_t piece_of(int kind_base, int state)
+{
+	struct piece_t p;
+
+	p.y = state % board_height;
+	p.x = state / board_height % state_columns + state_min_x;
+	p.which = kind_base + state / (board_height * state_columns);
+	return p;
+}
+
+/* the cells a placement covers, two orientations landing on the same
+ * cells are one placement
+ */
+static uint64_t landing_key(const struct piece_t *p)
+{
+	const struct tetromino_t *t = &tetromines[p->which];
+	uint64_t key = (uint64_t)p->y;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		key |= (uint64_t)1 << (5 + t->blocks[i].y * board_width
+							   + t->blocks[i].x + p->x);
+	return key;
+}
+
+static void find_landings(struct search_t *s, const struct engine_t *e)
+{
+	uint64_t keys[max_landings], key;
+	int base = e->curr.which - e->curr.which % 4;
+	int head = 0, tail = 0, st, next, m, i;
+	struct piece_t p, n;
+
+	memset(s->seen, 0, sizeof(s->seen));
+	s->count = 0;
+
+	st = state_of(e->curr.which, e->curr.x, e->curr.y);
+	s->seen[st] = 1;
+	s->parent[st] = -1;
+	s->depth[st] = 0;
+	s->queue[tail++] = (short)st;
+
+	while (head < tail) {
+		st = s->queue[head++];
+		p = piece_of(base, st);
+
+		for (m = move_rotate; m <= move_down; m++) {
+			n = p;
+			switch (m) {
+			case move_rotate:
+				n.which = piece_next[n.which];
+				break;
+			case move_left:
+				n.x--;
+				break;
+			case move_right:
+				n.x++;
+				break;
+			case move_down:
+				n.y++;
+				break;
+			}
+			if (n.x < state_min_x || n.x >= board_width
+				|| n.y >= board_height)
+				continue;
+			next = state_of(n.which, n.x, n.y);
+			if (s->seen[next])
+				continue;
+			s->seen[next] = 1;
+			if (engine_collides(e, n.which, n.x, n.y))
+				continue;
+			s->parent[next] = (short)st;
+			s->move[next] = (unsigned char)m;
+			s->depth[next] = (unsigned char)(s->depth[st] < 255
+											 ? s->depth[st] + 1 : 255);
+			s->queue[tail++] = (short)next;
+		}
+
+		if (!engine_collides(e, p.which, p.x, p.y+1)
+			|| s->depth[st] >= bot_max_moves-1 || s->count == max_landings)
+			continue;
+		key = landing_key(&p);
+		for (i = 0; i < s->count && keys[i] != key; i++)
+			;
+		if (i == s->count) {
+			keys[s->count] = key;
+			s->landing[s->count++] = (short)st;
+		}
+	}
+}
+
+double bot_evaluate(const struct bot_weights_t *w, const struct engine_t *e,
+					int lines)
+{
+	int x, left, right, d;
+	int height = 0, holes = engine_holes(e), bumps = 0, wells = 0;
+
+	for (x = 0; x < board_width; x++) {
+		height += e->heights[x];
+		if (x)
+			bumps += abs(e->heights[x] - e->heights[x-1]);
+		left = x ? e->heights[x-1] : board_height;
+		right = x < board_width-1 ? e->heights[x+1] : board_height;
+		d = (left < right ? left : right) - e->heights[x];
+		if (d > 0)
+			wells += d * (d+1) / 2;
+	}
+
+	return w->height * height + w->lines * lines + w->holes * holes
+		+ w->bumps * bumps + w->wells * wells;
+}
+
+/* the game after the placement, the next piece is current; 0 if it ends */
+static int place(struct engine_t *t, const struct engine_t *e, int state,
+				 int *lines)
+{
+	/* the bot plays only the standard board, a copy of constant size */
+	memcpy(t, e, engine_standard_size);
+	t->curr = piece_of(e->curr.which - e->curr.which % 4, state);
+	engine_lock(t);
+	*lines = engine_clear_lines(t);
+	return engine_spawn(t);
+}
+
+static void expand(const struct bot_t *b, struct bot_node_t *node)
+{
+	struct search_t s;
+	struct engine_t t;
+	int i, lines;
+	double score;
+
+	node->best = lost_score;
+	find_landings(&s, node->board);
+	for (i = 0; i < s.count; i++) {
+		if (!place(&t, node->board, s.landing[i], &lines))
+			continue;
+		score = bot_evaluate(&b->weights, &t, node->lines + lines);
+		if (score > node->best)
+			node->best = score;
+	}
+}
+
+#if !FOR_WINDOWS
+
+static void run_job(struct job_t *job)
+{
+	int i;
+
+	while ((i = __sync_fetch_and_add(&job->next, 1)) < job->count)
+		expand(job->bot, &job->nodes[i]);
+}
+
+struct bot_pool_t {
+	pthread_mutex_t lock;
+	pthread_cond_t work, done;
+	pthread_t threads[64];
+	int count;
+	unsigned long generation;
+	int running;		/* helpers still in the current job */
+	int quit;
+	struct job_t *job;
+};
+
+static void *pool_worker(void *arg)
+{
+	struct bot_pool_t *p = arg;
+	unsigned long seen = 0;
+
+	pthread_mutex_lock(&p->lock);
+	for (;;) {
+		while (p->generation == seen && !p->quit)
+			pthread_cond_wait(&p->work, &p->lock);
+		if (p->quit)
+			break;
+		seen = p->generation;
+		pthread_mutex_unlock(&p->lock);
+
+		run_job(p->job);
+
+		pthread_mutex_lock(&p->lock);
+		if (--p->running == 0)
+			pthread_cond_signal(&p->done);
+	}
+	pthread_mutex_unlock(&p->lock);
+	return NULL;
+}
+
+/* the caller works on the job too and returns when all of it is done */
+static void pool_run(struct bot_pool_t *p, struct job_t *job)
+{
+	pthread_mutex_lock(&p->lock);
+	p->job = job;
+	p->running = p->count;
+	p->generation++;
+	pthread_cond_broadcast(&p->work);
+	pthread_mutex_unlock(&p->lock);
+
+	run_job(job);
+
+	pthread_mutex_lock(&p->lock);
+	while (p->running)
+		pthread_cond_wait(&p->done, &p->lock);
+	pthread_mutex_unlock(&p->lock);
+}
+
+static struct bot_pool_t *pool_create(int helpers)
+{
+	struct bot_pool_t *p = malloc(sizeof(*p));
+
+	if (!p)
+		return NULL;
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->work, NULL);
+	pthread_cond_init(&p->done, NULL);
+	p->generation = 0;
+	p->running = 0;
+	p->quit = 0;
+	p->job = NULL;
+
+	if (helpers > (int)(sizeof(p->threads) / sizeof(p->threads[0])))
+		helpers = sizeof(p->threads) / sizeof(p->threads[0]);
+	for (p->count = 0; p->count < helpers; p->count++)
+		if (pthread_create(&p->threads[p->count], NULL, pool_worker, p) != 0)
+			break;
+	return p;
+}
+
+static void pool_destroy(struct bot_pool_t *p)
+{
+	int i;
+
+	pthread_mutex_lock(&p->lock);
+	p->quit = 1;
+	pthread_cond_broadcast(&p->work);
+	pthread_mutex_unlock(&p->lock);
+	for (i = 0; i < p->count; i++)
+		pthread_join(p->threads[i], NULL);
+
+	pthread_cond_destroy(&p->done);
+	pthread_cond_destroy(&p->work);
+	pthread_mutex_destroy(&p->lock);
+	free(p);
+}
+
+#endif
+
+int bot_init(struct bot_t *b, int threads, int beam)
+{
+	b->weights = bot_default_weights;
+	b->beam = beam < 1 ? 1 : beam;
+	b->pool = NULL;
+	b->nodes = malloc(max_landings * sizeof(*b->nodes));
+	b->boards = malloc(max_landings * board_stride);
+	if (!b->nodes || !b->boards) {
+		free(b->nodes);
+		free(b->boards);
+		return 0;
+	}
+
+#if !FOR_WINDOWS
+	if (threads > 1) {
+		b->pool = pool_create(threads-1);
+		if (!b->pool) {
+			free(b->nodes);
+			free(b->boards);
+			return 0;
+		}
+	}
+#endif
+	return 1;
+}
+
+void bot_free(struct bot_t *b)
+{
+#if !FOR_WINDOWS
+	if (b->pool)
+		pool_destroy(b->pool);
+#endif
+	free(b->nodes);
+	free(b->boards);
+	b->pool = NULL;
+	b->nodes = NULL;
+	b->boards = NULL;
+}
+
+static int by_score(const void *a, const void *b)
+{
+	double sa = ((const struct bot_node_t *)a)->score;
+	double sb = ((const struct bot_node_t *)b)->score;
+
+	return sa < sb ? 1 : sa > sb ? -1 : 0;
+}
+
+static int make_moves(const struct search_t *s, int state,
+					  enum engine_input moves[bot_max_moves])
+{
+	static const enum engine_input inputs[] = {
+		input_rotate, input_left, input_right, input_down
+	};
+	int n = s->depth[state], i;
+
+	for (i = n-1; i >= 0; i--, state = s->parent[state])
+		moves[i] = inputs[s->move[state]];
+	/* the drop makes the downs at the end */
+	while (n > 0 && moves[n-1] == input_down)
+		n--;
+	moves[n++] = input_drop;
+	return n;
+}
+
+int bot_plan(struct bot_t *b, const struct engine_t *e,
+			 enum engine_input moves[bot_max_moves])
+{
+	struct search_t s;
+	struct job_t job;
+	struct bot_node_t *best = NULL;
+	int i, count = 0;
+
+	if (e->game_over || e->width != board_width || e->height != board_height)
+		return 0;
+
+	find_landings(&s, e);
+	for (i = 0; i < s.count; i++) {
+		struct bot_node_t *node = &b->nodes[count];
+
+		node->state = s.landing[i];
+		node->board = (struct engine_t *)(b->boards + count * board_stride);
+		if (!place(node->board, e, node->state, &node->lines))
+			continue;
+		node->score = bot_evaluate(&b->weights, node->board, node->lines);
+		count++;
+	}
+	if (!count)
+		return 0;
+
+	qsort(b->nodes, count, sizeof(b->nodes[0]), by_score);
+	job.bot = b;
+	job.nodes = b->nodes;
+	job.count = count < b->beam ? count : b->beam;
+	job.next = 0;
+#if FOR_WINDOWS
+	for (i = 0; i < job.count; i++)
+		expand(b, &b->nodes[i]);
+#else
+	if (b->pool)
+		pool_run(b->pool, &job);
+	else
+		run_job(&job);
+#endif
+
+	/* if the next piece cannot be placed anyway, the first level decides */
+	for (i = 0; i < job.count; i++)
+		if (!best || b->nodes[i].best > best->best)
+			best = &b->nodes[i];
+	if (best->best == lost_score)
+		best = &b->nodes[0];
+
+	return make_moves(&s, best->state, moves);
+}
@@ -0,0 +1,53 @@
+#ifndef SENTRY_H_BOT
+#define SENTRY_H_BOT
+
+#include "engine.h"
+
+/* Autoplay. Every placement the current piece can reach with the moves a
+ * player has is scored by a weighted heuristic, the best bot->beam of them
+ * are searched again with the next piece and the placement leading to the
+ * best board wins. The second level runs on a pool of threads. The bot
+ * plays the standard board only.
+ */
+
+enum { bot_max_moves = 64, bot_default_beam = 8 };
+
+struct bot_weights_t {
+	double height;		/* sum of the column heights */
+	double lines;		/* lines removed */
+	double holes;		/* empty cells under an occupied one */
+	double bumps;		/* height differences of neighbour columns */
+	double wells;		/* 1+2+..+depth of every column below both neighbours */
+};
+
+struct bot_pool_t;
+struct bot_node_t;
+
+struct bot_t {
+	struct bot_weights_t weights;
+	int beam;
+	struct bot_pool_t *pool;	/* NULL searches on the caller's thread */
+	struct bot_node_t *nodes;	/* placements of the current piece */
+	unsigned char *boards;		/* the games after them */
+};
+
+extern const struct bot_weights_t bot_default_weights;
+
+/* threads counts the caller, 1 starts no threads; returns 0 on failure */
+int bot_init(struct bot_t *b, int threads, int beam);
+void bot_free(struct bot_t *b);
+
+/* the heuristic of the search, for the board of a game on the standard
+ * board after lines were removed
+ */
+double bot_evaluate(const struct bot_weights_t *w, const struct engine_t *e,
+					int lines);
+
+/* Fills moves with the inputs that take the current piece to the chosen
+ * placement, input_drop last. Returns their number, 0 if every placement
+ * ends the game or the board is not the standard one.
+ */
+int bot_plan(struct bot_t *b, const struct engine_t *e,
+			 enum engine_input moves[bot_max_moves]);
+
+#endif
@@ -0,0 +1,197 @@
+#include <stdio.h> /* sprintf */
+#include <string.h> /* memcpy */
+#include <time.h> /* time, nanosleep */
+#include <errno.h> /* errno */
+#include <unistd.h> /* write, close */
+#include <fcntl.h> /* open */
+#include <signal.h> /* sigemptyset, sigaddset */
+#include <pthread.h>
+#include "ring.h"
+#include "cast.h"
+
+/* the writer sleeps cast_nap_ms when the ring is empty, the game never
+ * wakes it
+ */
+enum { cast_ring_size = 1 << 20, cast_nap_ms = 10, cast_out_size = 16384,
+	   cast_read_size = 1024 };
+
+/* a piece of output or a new size in the ring, its bytes follow */
+struct cast_chunk_t {
+	unsigned long ms;
+	int len;
+	char code;		/* 'o' for output, 'r' for a resize to "WxH" */
+};
+
+struct cast_t {
+	struct ring_t ring;
+	int fd;
+	pthread_t thread;
+	volatile int quit;
+	int failed;
+	char out[cast_out_size];
+	int out_len;
+};
+
+static struct cast_t cast;
+
+static void flush_out(struct cast_t *c)
+{
+	int n, done = 0;
+
+	while (!c->failed && done < c->out_len) {
+		n = write(c->fd, c->out + done, c->out_len - done);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			c->failed = 1;
+			break;
+		}
+		done += n;
+	}
+	c->out_len = 0;
+}
+
+static void put_out(struct cast_t *c, const char *s, int n)
+{
+	if (c->out_len + n > cast_out_size)
+		flush_out(c);
+	memcpy(c->out + c->out_len, s, n);
+	c->out_len += n;
+}
+
+/* a JSON string: quotes, backslashes and control characters are escaped,
+ * UTF-8 goes as it is
+ */
+static void put_escaped(struct cast_t *c, const unsigned char *s, int n)
+{
+	char buf[8];
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if (s[i] == '"' || s[i] == '\\') {
+			buf[0] = '\\';
+			buf[1] = (char)s[i];
+			put_out(c, buf, 2);
+		} else if (s[i] < 0x20 || s[i] == 0x7f) {
+			sprintf(buf, "\\u%04x", s[i]);
+			put_out(c, buf, 6);
+		} else
+			put_out(c, (const char *)&s[i], 1);
+	}
+}
+
+/* [time, "o", data] or [time, "r", "WxH"] */
+static void put_event(struct cast_t *c, const struct cast_chunk_t *chunk)
+{
+	unsigned char data[cast_read_size];
+	char buf[64];
+	int left, n;
+
+	put_out(c, buf, sprintf(buf, "[%lu.%03lu, \"%c\", \"", chunk->ms / 1000,
+							chunk->ms % 1000, chunk->code));
+	for (left = chunk->len; left > 0; left -= n) {
+		n = left < cast_read_size ? left : cast_read_size;
+		ring_read(&c->ring, data, n);
+		put_escaped(c, data, n);
+	}
+	put_out(c, "\"]\n", 3);
+}
+
+static void *write_cast(void *arg)
+{
+	struct cast_t *c = arg;
+	struct cast_chunk_t chunk;
+	struct timespec nap;
+	sigset_t mask;
+	int quit;
+
+	/* a reader of the pipe that goes away fails write(), it does not kill
+	 * the game
+	 */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+	nap.tv_sec = 0;
+	nap.tv_nsec = cast_nap_ms * 1000000L;
+	for (;;) {
+		/* everything published before quit is in the ring */
+		quit = c->quit;
+		__sync_synchronize();
+		/* a chunk and its bytes are published together */
+		while (ring_used(&c->ring) >= sizeof(chunk)) {
+			ring_read(&c->ring, &chunk, sizeof(chunk));
+			put_event(c, &chunk);
+		}
+		flush_out(c);
+		if (quit)
+			break;
+		nanosleep(&nap, NULL);
+	}
+	return NULL;
+}
+
+int cast_open(const char *path, int width, int height)
+{
+	char buf[128];
+
+	cast.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (cast.fd < 0)
+		return 0;
+	if (!ring_init(&cast.ring, cast_ring_size)) {
+		close(cast.fd);
+		errno = ENOMEM;
+		return 0;
+	}
+	cast.quit = 0;
+	cast.failed = 0;
+	cast.out_len = 0;
+
+	put_out(&cast, buf, sprintf(buf, "{\"version\": 2, \"width\": %d, "
+								"\"height\": %d, \"timestamp\": %ld}\n",
+								width, height, (long)time(NULL)));
+	flush_out(&cast);
+	if (cast.failed || pthread_create(&cast.thread, NULL, write_cast,
+									  &cast) != 0) {
+		ring_free(&cast.ring);
+		close(cast.fd);
+		return 0;
+	}
+	return 1;
+}
+
+static int put_chunk(unsigned long ms, char code, const char *data, int len)
+{
+	struct cast_chunk_t chunk;
+
+	if (ring_room(&cast.ring) < sizeof(chunk) + len)
+		return 0;
+	chunk.ms = ms;
+	chunk.len = len;
+	chunk.code = code;
+	ring_write(&cast.ring, &chunk, sizeof(chunk));
+	ring_write(&cast.ring, data, len);
+	ring_publish(&cast.ring);
+	return 1;
+}
+
+int cast_output(unsigned long ms, const char *data, int len)
+{
+	return put_chunk(ms, 'o', data, len);
+}
+
+int cast_resize(unsigned long ms, int width, int height)
+{
+	char buf[32];
+
+	return put_chunk(ms, 'r', buf, sprintf(buf, "%dx%d", width, height));
+}
+
+int cast_close()
+{
+	__sync_synchronize();
+	cast.quit = 1;
+	pthread_join(cast.thread, NULL);
+	ring_free(&cast.ring);
+	return close(cast.fd) == 0 && !cast.failed;
+}
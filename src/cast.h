@@ -0,0 +1,21 @@
+#ifndef SENTRY_H_CAST
+#define SENTRY_H_CAST
+
+/* --cast: the terminal output as an asciicast v2 file. The game thread only
+ * copies each piece of output and its time into a ring; a writer thread
+ * turns them into JSON lines and writes them, so a slow file or pipe never
+ * holds the game up. Times are ms of the game clock.
+ */
+
+/* writes the header and starts the writer, returns 0 with errno set if
+ * path cannot be opened
+ */
+int cast_open(const char *path, int width, int height);
+/* returns 0 if the ring is full, the output is not recorded then */
+int cast_output(unsigned long ms, const char *data, int len);
+/* the terminal is width x height from now on, returns 0 as cast_output() */
+int cast_resize(unsigned long ms, int width, int height);
+/* returns once everything is written, 0 if a write failed */
+int cast_close();
+
+#endif
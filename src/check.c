@@ -0,0 +1,643 @@
+#include <stdio.h>
+#include <stdlib.h> /* rand, srand, malloc, free */
+#include <string.h> /* memset, memcmp, memcpy */
+#include <unistd.h> /* close, unlink */
+#include "engine.h"
+#include "rows.h"
+#include "replay.h"
+#include "save.h"
+#include "input.h"
+#include "bot.h"
+
+/* Checks of the engine against plain code that looks at one cell at a
+ * time, and of the files against the games that wrote them. make check
+ * builds and runs them, every failure is told on stderr and the exit
+ * status is 1 if there was any.
+ */
+
+enum { check_seed = 12345, check_steps = 300 };
+
+/* pieces of the recorded game where seeking is tried: the start, around
+ * keyframes and between them
+ */
+static const unsigned long seek_pieces[] = {
+	0, 1, replay_interval-1, replay_interval, replay_interval+1, 50,
+	2*replay_interval, 100, 3*replay_interval+5
+};
+
+enum { seek_count = sizeof(seek_pieces) / sizeof(seek_pieces[0]) };
+
+static int failures;
+
+/* counts and tells a failure, returns ok; n is the board width or the
+ * number of the case
+ */
+static int check(int ok, const char *what, int n)
+{
+	if (!ok) {
+		fprintf(stderr, "check: %s, %d\n", what, n);
+		failures++;
+	}
+	return ok;
+}
+
+static int cell(const row_t *row, int x)
+{
+	return row[x/32] >> (x%32) & 1;
+}
+
+/* the row words of width cells, nothing past the width */
+static void random_row(row_t *row, int width, int fill)
+{
+	int x;
+
+	memset(row, 0, row_words(width) * sizeof(row_t));
+	for (x = 0; x < width; x++)
+		if (rand() % 100 < fill)
+			row[x/32] |= 1u << (x%32);
+}
+
+static int full_reference(const row_t *row, int width)
+{
+	int x;
+
+	for (x = 0; x < width; x++)
+		if (!cell(row, x))
+			return 0;
+	return 1;
+}
+
+static int holes_reference(const row_t *rows, int width, int height)
+{
+	int x, y, covered, holes = 0, words = row_words(width);
+
+	for (x = 0; x < width; x++) {
+		covered = 0;
+		for (y = 0; y < height; y++) {
+			if (cell(rows + y*words, x))
+				covered = 1;
+			else
+				holes += covered;
+		}
+	}
+	return holes;
+}
+
+/* every kernel the CPU runs on every width: full rows, rows full but for
+ * one cell, random rows, and the holes of random boards
+ */
+static void check_rows()
+{
+	static row_t rows[board_max_height * row_words(board_max_width)];
+	int isa, width, words, height, x, y;
+
+	for (isa = 0; isa < row_isa_count; isa++) {
+		if (!row_isa_supported(isa))
+			continue;
+		srand(check_seed);
+		for (width = 1; width <= board_max_width; width++) {
+			words = row_words(width);
+			random_row(rows, width, 100);
+			check(rows_full_isa(isa, rows, width), "full row", width);
+			for (x = 0; x < width; x++) {
+				rows[x/32] &= ~(1u << (x%32));
+				check(!rows_full_isa(isa, rows, width), "row with a gap",
+					  width);
+				rows[x/32] |= 1u << (x%32);
+			}
+			random_row(rows, width, 95);
+			check(rows_full_isa(isa, rows, width)
+				  == full_reference(rows, width), "random row", width);
+
+			height = 1 + rand() % board_max_height;
+			for (y = 0; y < height; y++)
+				random_row(rows + y*words, width, 50);
+			check(rows_holes_isa(isa, rows, words, height)
+				  == holes_reference(rows, width, height), "holes", width);
+		}
+	}
+}
+
+static void set_cell(struct engine_t *e, int x, int y, int color)
+{
+	e->rows[y * row_words(e->width) + x/32] |= 1u << (x%32);
+	engine_color(e, x, y) = (unsigned char)color;
+}
+
+/* Four bottom rows full but for the column of a vertical I, the second of
+ * them has a second gap, random rows above: the I removes three lines and
+ * everything above them moves down with its colors.
+ */
+static void check_clear(int width)
+{
+	static unsigned char before[board_max_height][board_max_width];
+	static unsigned char after[board_max_height][board_max_width];
+	struct engine_any_t room;
+	struct engine_t *e = &room.e;
+	int height = board_height, words = row_words(width), gap = rand() % width,
+		gap2, x, y, dst;
+
+	do
+		gap2 = rand() % width;
+	while (gap2 == gap);
+
+	engine_init_size(e, check_seed, randomizer_uniform, width, height);
+	memset(before, 0, sizeof(before));
+	for (y = height-8; y < height; y++) {
+		for (x = 0; x < width; x++) {
+			if (y >= height-4 ? x == gap || (y == height-3 && x == gap2)
+				: rand() % 2)
+				continue;
+			before[y][x] = (unsigned char)(1 + rand() % 7);
+			set_cell(e, x, y, before[y][x]);
+		}
+	}
+	engine_rebuild(e);
+
+	/* the I stands in column gap, its blocks are at x = 1 */
+	e->curr.which = 4;
+	e->curr.x = gap - 1;
+	e->curr.y = height - 4;
+	for (y = height-4; y < height; y++)
+		before[y][gap] = piece_kind(4) + 1;
+
+	memset(after, 0, sizeof(after));
+	for (y = dst = height-1; y >= 0; y--) {
+		for (x = 0; x < width && before[y][x]; x++)
+			;
+		if (x == width)
+			continue;
+		memcpy(after[dst--], before[y], width);
+	}
+
+	engine_lock(e);
+	check(engine_clear_lines(e) == 3, "lines removed", width);
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x++) {
+			if (!check(cell(e->rows + y*words, x) == !!after[y][x]
+					   && engine_color(e, x, y) == after[y][x],
+					   "cell after the clear", width))
+				return;
+		}
+	}
+	engine_spawn(e);
+	check(engine_valid(e), "game after the clear", width);
+}
+
+/* the cells of the piece at x, y are off the board or occupied; no top
+ * border
+ */
+static int collides_reference(const struct engine_t *e, int which, int x,
+							  int y)
+{
+	int i, cx, cy;
+
+	for (i = 0; i < 4; i++) {
+		cx = x + tetromines[which].blocks[i].x;
+		cy = y + tetromines[which].blocks[i].y;
+		if (cx < 0 || cx >= e->width || cy >= e->height)
+			return 1;
+		if (cy >= 0 && cell(e->rows + cy * row_words(e->width), cx))
+			return 1;
+	}
+	return 0;
+}
+
+/* heights from the cells, the slots one per row */
+static int board_reference(const struct engine_t *e)
+{
+	unsigned char used[board_max_height];
+	int x, y;
+
+	for (x = 0; x < e->width; x++) {
+		for (y = 0; y < e->height; y++)
+			if (cell(e->rows + y * row_words(e->width), x))
+				break;
+		if (e->heights[x] != e->height - y)
+			return 0;
+	}
+	memset(used, 0, sizeof(used));
+	for (y = 0; y < e->height; y++) {
+		if (engine_slots(e)[y] >= e->height || used[engine_slots(e)[y]])
+			return 0;
+		used[engine_slots(e)[y]] = 1;
+	}
+	return 1;
+}
+
+/* Random inputs, more drops than a player makes, with a new game when one
+ * ends. After every lock the heights and the slots, after every step the
+ * drop distance of the current piece and the collisions of random pieces
+ * anywhere around the board are the reference ones.
+ */
+static void check_play(int width, int height)
+{
+	static const enum engine_input inputs[] = {
+		input_left, input_right, input_rotate, input_down, input_tick,
+		input_drop, input_drop
+	};
+	struct engine_any_t room;
+	struct engine_t *e = &room.e;
+	unsigned long pieces = 0;
+	int step, i, d, which, x, y;
+
+	engine_init_size(e, check_seed, randomizer_bag, width, height);
+	for (step = 0; step < check_steps; step++) {
+		if (e->game_over)
+			engine_init_size(e, check_seed + step, randomizer_bag, width,
+							 height);
+		engine_step(e, inputs[rand() % (sizeof(inputs) / sizeof(inputs[0]))]);
+
+		/* only a lock changes the board */
+		if (e->pieces != pieces) {
+			pieces = e->pieces;
+			if (!check(board_reference(e) && engine_valid(e), "board",
+					   width))
+				return;
+		}
+		if (!e->game_over) {
+			for (d = 0; !collides_reference(e, e->curr.which, e->curr.x,
+											e->curr.y + d+1); d++)
+				;
+			if (!check(engine_drop_distance(e, &e->curr) == d,
+					   "drop distance", width))
+				return;
+		}
+		for (i = 0; i < 8; i++) {
+			which = rand() % tetromino_count;
+			x = rand() % (width + 8) - 4;
+			y = rand() % (height + 8) - 4;
+			if (!check(engine_collides(e, which, x, y)
+					   == collides_reference(e, which, x, y),
+					   "collision", width))
+				return;
+		}
+	}
+}
+
+/* a file name of its own in /tmp, the caller removes the file */
+static int temp_path(char *path)
+{
+	int fd;
+
+	strcpy(path, "/tmp/tetris-check-XXXXXX");
+	fd = mkstemp(path);
+	if (fd < 0) {
+		perror("check: mkstemp");
+		return 0;
+	}
+	close(fd);
+	return 1;
+}
+
+static int same_game(const struct engine_t *a, const struct engine_t *b)
+{
+	return engine_size(a) == engine_size(b) && !memcmp(a, b, engine_size(a));
+}
+
+/* the state at piece of a replay just opened; 0 if it ends before that */
+static int seek(const char *path, unsigned long piece, struct engine_t *e)
+{
+	struct replay_t r;
+	int ok;
+
+	if (!replay_open(&r, path))
+		return 0;
+	engine_init_size(e, r.seed, (enum randomizer_t)r.randomizer, r.width,
+					 r.height);
+	e->gravity = r.gravity;
+	ok = replay_seek(&r, e, piece);
+	replay_close(&r);
+	return ok;
+}
+
+static int write_file(const char *path, const unsigned char *data, long len)
+{
+	FILE *fp = fopen(path, "wb");
+
+	return fp && fwrite(data, 1, len, fp) == (size_t)len && !fclose(fp);
+}
+
+/* the whole file in a buffer of its own, NULL if it cannot be read */
+static unsigned char *read_file(const char *path, long *len)
+{
+	FILE *fp = fopen(path, "rb");
+	unsigned char *data = NULL;
+
+	if (fp && fseek(fp, 0, SEEK_END) == 0 && (*len = ftell(fp)) > 0
+		&& fseek(fp, 0, SEEK_SET) == 0 && (data = malloc(*len)) != NULL
+		&& fread(data, 1, *len, fp) != (size_t)*len) {
+		free(data);
+		data = NULL;
+	}
+	if (fp)
+		fclose(fp);
+	return data;
+}
+
+/* a field of struct engine_t that makes a keyframe unusable, and any
+ * saved game too when invalid is set
+ */
+struct spoil_t {
+	const char *what;
+	size_t offset;
+	int value;
+	int invalid;
+};
+
+static const struct spoil_t spoils[] = {
+	{ "piece out of range", offsetof(struct engine_t, curr.which),
+	  tetromino_count, 1 },
+	{ "no gravity", offsetof(struct engine_t, gravity), 0, 1 },
+	{ "pieces not indexed", offsetof(struct engine_t, pieces), 1, 0 }
+};
+
+/* writes the value over the field in the keyframes after the first */
+static int spoil_keyframes(const char *path, const struct spoil_t *spoil)
+{
+	struct replay_t r;
+	FILE *fp;
+	int i;
+
+	if (!replay_open(&r, path))
+		return 0;
+	fp = fopen(path, "r+b");
+	for (i = 1; fp && i < r.count; i++) {
+		fseek(fp, (long)r.index[i].offset + 5 + spoil->offset, SEEK_SET);
+		fwrite(&spoil->value, sizeof(spoil->value), 1, fp);
+	}
+	replay_close(&r);
+	return fp && fclose(fp) == 0;
+}
+
+/* Records a game and keeps it as it was when each of seek_pieces was
+ * reached. Seeking the replay there has to give the same game, from the
+ * keyframes and again once they are spoiled in each of the ways above. A
+ * header without gravity is turned down. The bot plays the standard
+ * board, where random play ends too soon, and random inputs the others.
+ */
+static void check_replay(int width, int height)
+{
+	static const enum engine_input inputs[] = {
+		input_left, input_right, input_rotate, input_tick, input_drop,
+		input_drop
+	};
+	struct engine_any_t room, seen_room;
+	struct engine_t *e = &room.e, *seen = &seen_room.e;
+	struct engine_t *at[seek_count];
+	struct replay_t r;
+	struct bot_t bot;
+	enum engine_input in, moves[bot_max_moves];
+	char path[32];
+	unsigned char *file;
+	unsigned long ms = 0;
+	long len = 0;
+	int i, j, k = 0, count = 0, next = 0;
+
+	if (!temp_path(path) || !check(bot_init(&bot, 1, 1), "bot", width))
+		return;
+	engine_init_size(e, check_seed, randomizer_bag, width, height);
+	e->gravity = 1;
+	if (!check(replay_create(&r, path, e, check_seed), "replay created",
+			   width)) {
+		bot_free(&bot);
+		unlink(path);
+		return;
+	}
+	memset(at, 0, sizeof(at));
+	for (;;) {
+		while (k < seek_count && e->pieces == seek_pieces[k]) {
+			at[k] = malloc(engine_alloc_size(width, height));
+			if (at[k])
+				memcpy(at[k], e, engine_size(e));
+			k++;
+		}
+		if (k == seek_count || e->game_over)
+			break;
+		if (next == count) {
+			count = bot_plan(&bot, e, moves);
+			next = 0;
+		}
+		if (next < count)
+			in = moves[next++];
+		else
+			in = inputs[rand() % (sizeof(inputs) / sizeof(inputs[0]))];
+		engine_step(e, in);
+		replay_input(&r, in, ms += 10, e);
+	}
+	replay_close(&r);
+	check(k == seek_count, "game long enough to seek in", width);
+
+	for (i = 0; i < k; i++)
+		check(at[i] && seek(path, seek_pieces[i], seen)
+			  && same_game(seen, at[i]), "game at the seeked piece", width);
+	check(!seek(path, e->pieces + 1, seen), "seek past the end", width);
+	file = read_file(path, &len);
+	check(file != NULL, "replay read", width);
+	for (j = 0; file && j < (int)(sizeof(spoils) / sizeof(spoils[0])); j++) {
+		if (!check(write_file(path, file, len)
+				   && spoil_keyframes(path, &spoils[j]), spoils[j].what,
+				   width))
+			continue;
+		for (i = 0; i < k; i++)
+			check(at[i] && seek(path, seek_pieces[i], seen)
+				  && same_game(seen, at[i]), spoils[j].what, width);
+	}
+	if (file) {
+		/* the u32 gravity after magic, version, randomizer and seed */
+		memset(file + 12, 0, 4);
+		check(write_file(path, file, len) && !replay_open(&r, path),
+			  "replay without gravity", width);
+	}
+	free(file);
+
+	for (i = 0; i < k; i++)
+		free(at[i]);
+	bot_free(&bot);
+	unlink(path);
+}
+
+/* A game partly played is saved and read back whole. Then every byte of
+ * the file is changed in turn, 37 bytes apart, and the file cut short:
+ * the checksum or the header has to turn each down and leave the game
+ * read into as it was.
+ */
+/* the FNV-1a a save header holds for its state */
+static unsigned int save_checksum(const unsigned char *p, unsigned long n)
+{
+	unsigned int h = 2166136261u;
+	unsigned long i;
+
+	for (i = 0; i < n; i++) {
+		h ^= p[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static void check_save(int width, int height)
+{
+	static unsigned char file[sizeof(struct save_header_t)
+							  + sizeof(struct engine_any_t)];
+	struct engine_any_t room, loaded_room;
+	struct engine_t *e = &room.e, *loaded = &loaded_room.e;
+	char path[32];
+	struct save_header_t h;
+	unsigned char *state = file + sizeof(h);
+	FILE *fp;
+	long len, i;
+	int j, old;
+
+	if (!temp_path(path))
+		return;
+	engine_init_size(e, check_seed, randomizer_history, width, height);
+	for (i = 0; i < 40 && !e->game_over; i++)
+		engine_step(e, i % 4 ? input_left + rand() % 3 : input_drop);
+
+	check(save_read("/nonexistent/tetris-check", loaded) == 0,
+		  "missing save", width);
+	if (!check(save_write(path, e) && save_read(path, loaded) == 1
+			   && same_game(loaded, e), "game saved and read", width)
+		|| !check((fp = fopen(path, "rb")) != NULL, "save opened", width)) {
+		unlink(path);
+		return;
+	}
+	len = (long)fread(file, 1, sizeof(file), fp);
+	fclose(fp);
+	check(len == (long)(sizeof(struct save_header_t) + engine_size(e)),
+		  "save size", width);
+
+	for (i = 0; i < len; i += 37) {
+		file[i] ^= 0x10;
+		if (!check(write_file(path, file, len)
+				   && save_read(path, loaded) == -1
+				   && same_game(loaded, e), "changed byte turned down",
+				   width))
+			break;
+		file[i] ^= 0x10;
+	}
+	check(write_file(path, file, len - 1) && save_read(path, loaded) == -1
+		  && same_game(loaded, e), "short save turned down", width);
+
+	/* with the checksum made good again only the state can tell */
+	for (j = 0; j < (int)(sizeof(spoils) / sizeof(spoils[0])); j++) {
+		if (!spoils[j].invalid)
+			continue;
+		memcpy(&h, file, sizeof(h));
+		memcpy(&old, state + spoils[j].offset, sizeof(old));
+		memcpy(state + spoils[j].offset, &spoils[j].value, sizeof(old));
+		h.checksum = save_checksum(state, h.state_size);
+		memcpy(file, &h, sizeof(h));
+		check(write_file(path, file, len) && save_read(path, loaded) == -1
+			  && same_game(loaded, e), spoils[j].what, width);
+		memcpy(state + spoils[j].offset, &old, sizeof(old));
+		h.checksum = save_checksum(state, h.state_size);
+		memcpy(file, &h, sizeof(h));
+	}
+	unlink(path);
+}
+
+/* bytes as the terminal sends them and the keys they are, up to -1 */
+struct key_case_t {
+	const char *bytes;
+	int keys[8];
+};
+
+static const struct key_case_t key_cases[] = {
+	{ "a", { 'a', -1 } },
+	{ "\x1b[A\x1b[B\x1b[C\x1b[D",
+	  { key_up, key_down, key_right, key_left, -1 } },
+	{ "\x1bOA\x1bOD", { key_up, key_left, -1 } },
+	{ "\x1b[1;5D\x1b[1;2C", { key_left, key_right, -1 } },
+	{ "\x1b[I\x1b[O\x1b[200~x", { 'x', -1 } },
+	{ "\x1bq", { key_esc, 'q', -1 } },
+	{ "\x1b\x1b[A", { key_esc, key_up, -1 } },
+	{ "\x1b", { key_esc, -1 } },
+	{ "\x1b[\x03", { 3, -1 } },
+	{ "ad\x1b[Cw \x1b[D", { 'a', 'd', key_right, 'w', ' ', key_left, -1 } }
+};
+
+/* the keys of bytes fed in reads of step bytes, the first of them first
+ * bytes long, and the Esc timeout at the end
+ */
+static int decode(struct input_t *in, const char *bytes, int first, int step,
+				  int *keys)
+{
+	int len = (int)strlen(bytes), i = 0, n, count = 0;
+
+	input_init(in);
+	for (n = first; i < len; i += n, n = step) {
+		if (n > len - i)
+			n = len - i;
+		input_feed(in, (const unsigned char *)bytes + i, n);
+	}
+	input_timeout(in);
+	while (count < 8 && (keys[count] = input_next(in)) != -1)
+		count++;
+	return count;
+}
+
+/* Every case split at every byte and byte by byte has to give its keys,
+ * a sequence is one key however the reads cut it. A full queue takes no
+ * more bytes and gives its keys in order.
+ */
+static void check_input()
+{
+	struct input_t in;
+	unsigned char buf[input_queue_size];
+	int keys[8], c, i, n, split;
+
+	for (c = 0; c < (int)(sizeof(key_cases) / sizeof(key_cases[0])); c++) {
+		for (n = 0; key_cases[c].keys[n] != -1; n++)
+			;
+		for (split = 0; split <= (int)strlen(key_cases[c].bytes); split++) {
+			if (!check(decode(&in, key_cases[c].bytes, split,
+							  (int)strlen(key_cases[c].bytes), keys) == n
+					   && !memcmp(keys, key_cases[c].keys, n * sizeof(int)),
+					   "keys of case", c))
+				break;
+		}
+		check(decode(&in, key_cases[c].bytes, 1, 1, keys) == n
+			  && !memcmp(keys, key_cases[c].keys, n * sizeof(int)),
+			  "keys of case a byte at a time", c);
+	}
+
+	input_init(&in);
+	for (i = 0; i < input_queue_size; i++)
+		buf[i] = (unsigned char)('a' + i % 26);
+	input_feed(&in, buf, input_room(&in));
+	check(input_room(&in) == 0, "full queue", input_queue_size);
+	for (i = 0; i < input_queue_size; i++)
+		if (!check(input_next(&in) == 'a' + i % 26, "queue order", i))
+			break;
+	check(input_next(&in) == -1 && input_room(&in) == input_queue_size,
+		  "empty queue", input_queue_size);
+}
+
+int main()
+{
+	int width;
+
+	check_rows();
+	srand(check_seed);
+	for (width = board_min_width; width <= board_max_width; width++)
+		check_clear(width);
+	for (width = board_min_width; width <= board_max_width; width++) {
+		check_play(width, board_height);
+		check_play(width, width % 2 ? board_min_height : board_max_height);
+	}
+	check_replay(board_width, board_height);
+	check_replay(40, board_max_height);
+	check_replay(board_max_width, board_max_height);
+	check_save(board_width, board_height);
+	check_save(40, board_max_height);
+	check_save(board_max_width, board_max_height);
+	check_input();
+
+	if (failures) {
+		fprintf(stderr, "check: %d failed\n", failures);
+		return 1;
+	}
+	printf("check: all passed\n");
+	return 0;
+}
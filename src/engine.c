@@ -0,0 +1,221 @@
+#include <string.h> /* memset, memcpy, memchr, memmove */
+#include "engine.h"
+#include "rows.h"
+#include "piece_tables.h"
+
+const char *const randomizer_names[randomizer_count] = {
+	"uniform", "bag", "history"
+};
+
+enum { history_rolls = 4 };
+
+static unsigned int rotl(unsigned int x, int k)
+{
+	return (x << k) | (x >> (32 - k));
+}
+
+/* xoshiro128** by D. Blackman and S. Vigna: 16 bytes of state per game */
+static unsigned int next_random(struct engine_t *e)
+{
+	unsigned int *s = e->rng;
+	unsigned int res = rotl(s[1] * 5, 7) * 9;
+	unsigned int t = s[1] << 9;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl(s[3], 11);
+
+	return res;
+}
+
+/* splitmix32 spreads the seed over the state, which can never be all zero */
+static void seed_random(struct engine_t *e, unsigned int seed)
+{
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		unsigned int z = (seed += 0x9e3779b9u);
+		z = (z ^ (z >> 16)) * 0x85ebca6bu;
+		z = (z ^ (z >> 13)) * 0xc2b2ae35u;
+		e->rng[i] = z ^ (z >> 16);
+	}
+}
+
+static int next_kind(struct engine_t *e)
+{
+	int i, k, kind = 0;
+
+	switch (e->randomizer) {
+	case randomizer_bag:
+		if (!e->bag_left) {
+			for (i = 0; i < 7; i++)
+				e->bag[i] = (unsigned char)i;
+			e->bag_left = 7;
+		}
+		k = next_random(e) % e->bag_left;
+		kind = e->bag[k];
+		e->bag[k] = e->bag[--e->bag_left];
+		break;
+	case randomizer_history:
+		for (i = 0; i < history_rolls; i++) {
+			kind = next_random(e) % 7;
+			if (!memchr(e->history, kind, sizeof(e->history)))
+				break;
+		}
+		memmove(e->history + 1, e->history, sizeof(e->history) - 1);
+		e->history[0] = (unsigned char)kind;
+		break;
+	}
+
+	return kind;
+}
+
+/* the standard board, then any size */
+#define board_w board_width
+#define board_h board_height
+#define board_fn(name) name##_standard
+#include "engine_board.h"
+#undef board_w
+#undef board_h
+#undef board_fn
+
+#define board_w (e->width)
+#define board_h (e->height)
+#define board_fn(name) name##_any
+#include "engine_board.h"
+#undef board_w
+#undef board_h
+#undef board_fn
+
+#define is_standard(e) \
+	((e)->width == board_width && (e)->height == board_height)
+
+void engine_init(struct engine_t *e, unsigned int seed,
+				 enum randomizer_t randomizer)
+{
+	engine_init_size(e, seed, randomizer, board_width, board_height);
+}
+
+void engine_init_size(struct engine_t *e, unsigned int seed,
+					  enum randomizer_t randomizer, int width, int height)
+{
+	int y;
+
+	memset(e, 0, engine_bytes(width, height));
+	e->width = width;
+	e->height = height;
+	for (y = 0; y < height; y++)
+		engine_slots(e)[y] = (unsigned char)y;
+	e->gravity = 1;
+	seed_random(e, seed);
+	e->randomizer = randomizer;
+	/* the history starts with the kinds that are worst to begin with */
+	e->history[0] = e->history[2] = 3;
+	e->history[1] = e->history[3] = 2;
+	if (is_standard(e)) {
+		new_tetromino_standard(e, &e->curr);
+		new_tetromino_standard(e, &e->next);
+	} else {
+		new_tetromino_any(e, &e->curr);
+		new_tetromino_any(e, &e->next);
+	}
+}
+
+void engine_copy(struct engine_t *dst, const struct engine_t *src)
+{
+	if (is_standard(src))
+		copy_standard(dst, src);
+	else
+		copy_any(dst, src);
+}
+
+int engine_valid(const struct engine_t *e)
+{
+	unsigned char used[board_max_height];
+	const unsigned char *slots = engine_slots(e);
+	int x, y, i, words = row_words(e->width);
+	row_t past = e->width % 32 ? ~row_mask(e->width % 32) : 0;
+
+	if (e->width < board_min_width || e->width > board_max_width
+		|| e->height < board_min_height || e->height > board_max_height
+		|| e->curr.which < 0 || e->curr.which >= tetromino_count
+		|| e->next.which < 0 || e->next.which >= tetromino_count
+		|| e->randomizer < 0 || e->randomizer >= randomizer_count
+		|| e->bag_left < 0 || e->bag_left > 7
+		|| e->gravity < 1 || e->gravity > board_max_height)
+		return 0;
+	for (i = 0; i < 7; i++)
+		if (e->bag[i] >= 7 || (i < 4 && e->history[i] >= 7))
+			return 0;
+
+	memset(used, 0, sizeof(used));
+	for (y = 0; y < e->height; y++) {
+		if (slots[y] >= e->height || used[slots[y]]
+			|| e->rows[y * words + words-1] & past)
+			return 0;
+		used[slots[y]] = 1;
+	}
+	for (x = 0; x < e->width; x++) {
+		for (y = 0; y < e->height; y++)
+			if (e->rows[y * words + x/32] >> (x%32) & 1)
+				break;
+		if (e->heights[x] != e->height - y)
+			return 0;
+	}
+
+	return e->game_over
+		|| !engine_collides(e, e->curr.which, e->curr.x, e->curr.y);
+}
+
+int engine_collides(const struct engine_t *e, int which, int x, int y)
+{
+	return is_standard(e) ? is_collision_standard(e, which, x, y)
+		: is_collision_any(e, which, x, y);
+}
+
+int engine_drop_distance(const struct engine_t *e, const struct piece_t *p)
+{
+	return is_standard(e) ? drop_distance_standard(e, p)
+		: drop_distance_any(e, p);
+}
+
+int engine_holes(const struct engine_t *e)
+{
+	return rows_holes(e->rows, row_words(e->width), e->height);
+}
+
+void engine_rebuild(struct engine_t *e)
+{
+	if (is_standard(e))
+		update_heights_standard(e);
+	else
+		update_heights_any(e);
+}
+
+void engine_lock(struct engine_t *e)
+{
+	if (is_standard(e))
+		lock_tetromino_standard(e);
+	else
+		lock_tetromino_any(e);
+}
+
+int engine_clear_lines(struct engine_t *e)
+{
+	return is_standard(e) ? clear_lines_standard(e) : clear_lines_any(e);
+}
+
+int engine_spawn(struct engine_t *e)
+{
+	return is_standard(e) ? spawn_standard(e) : spawn_any(e);
+}
+
+int engine_step(struct engine_t *e, enum engine_input in)
+{
+	if (e->game_over)
+		return step_game_over;
+	return is_standard(e) ? step_standard(e, in) : step_any(e, in);
+}
@@ -0,0 +1,160 @@
+#ifndef SENTRY_H_ENGINE
+#define SENTRY_H_ENGINE
+
+#include <stddef.h> /* offsetof */
+#include "tetromino.h"
+
+/* Render-free game engine. All coordinates are in board cells: x grows to
+ * the right from 0 to width-1, y grows down from 0 to height-1.
+ */
+
+/* The standard board. engine_init_size() makes any other size up to the
+ * maximum, the standard one has code of its own with the sizes folded in.
+ */
+enum { board_width = 13, board_height = 20 };
+
+enum { board_min_width = 4, board_min_height = 4,
+	   board_max_width = 256, board_max_height = 64 };
+
+enum engine_input {
+	input_none,
+	input_left,
+	input_right,
+	input_down,
+	input_rotate,
+	input_drop,		/* hard drop: fall to the bottom and lock */
+	input_tick		/* gravity: move down or lock */
+};
+
+/* how the next piece kind is chosen */
+enum randomizer_t {
+	randomizer_uniform,		/* any of the 28 tetrominoes */
+	randomizer_bag,			/* all 7 kinds in random order, then again */
+	randomizer_history,		/* reroll kinds among the last 4 dealt */
+	randomizer_count
+};
+
+/* engine_step result flags */
+enum {
+	step_moved = 1,
+	step_locked = 2,
+	step_lines = 4,
+	step_game_over = 8
+};
+
+struct piece_t {
+	int which;
+	int x, y;
+};
+
+/* A row is row_words(width) words, bit x%32 of word x/32 is set when
+ * cell x of that row is occupied. Boards up to 32 cells wide have rows of
+ * one word.
+ */
+typedef unsigned int row_t;
+
+#define row_words(width) (((width) + 31) / 32)
+
+/* a full word of a row width cells wide, width 1..32 */
+#define row_mask(width) ((row_t)(~0u >> (32 - (width))))
+#define full_row row_mask(board_width)
+
+/* the rows, a slot and the colors of every row of a board, in bytes */
+#define board_bytes(width, height) \
+	((height) * (row_words(width) * sizeof(row_t) + 1 + (width)))
+/* the same in row_t words, for the largest board and the standard one */
+#define board_storage ((board_bytes(board_max_width, board_max_height) \
+	+ sizeof(row_t)-1) / sizeof(row_t))
+#define board_standard_storage ((board_bytes(board_width, board_height) \
+	+ sizeof(row_t)-1) / sizeof(row_t))
+
+/* Room for the standard board. A larger one continues past the end of the
+ * struct, in memory of engine_alloc_size() bytes or in struct
+ * engine_any_t. The slots and colors are stored after the rows in use, so
+ * all of the game is its first engine_size() bytes, and only those are
+ * ever set or copied.
+ */
+struct engine_t {
+	int width, height;
+	/* rows from the bottom up to the topmost occupied cell of a column */
+	unsigned char heights[board_max_width];
+	struct piece_t curr;
+	struct piece_t next;
+	int score;
+	int lines;			/* lines removed by the last lock */
+	unsigned long cleared;	/* lines removed in the whole game */
+	int game_over;
+	int gravity;		/* rows per input_tick, board_max_height is 20G */
+	unsigned long pieces;
+	/* the piece sequence depends only on the seed and the randomizer */
+	unsigned int rng[4];
+	int randomizer;
+	int bag_left;
+	unsigned char bag[7];
+	unsigned char history[4];
+
+	/* height rows, height slots, then height*width colors: 0 is an empty
+	 * cell, otherwise the piece kind + 1 (see piece_kind). Board row y
+	 * keeps its colors in the width cells of slot y, so removing lines
+	 * only reorders the slots.
+	 */
+	row_t rows[board_standard_storage];
+};
+
+/* a game of any size that is not allocated, room for the largest board */
+struct engine_any_t {
+	struct engine_t e;
+	row_t more[board_storage - board_standard_storage];
+};
+
+extern const char *const randomizer_names[randomizer_count];
+
+/* a level every 10 lines, from 0 */
+#define engine_level(e) ((int)((e)->cleared / 10))
+
+#define engine_row(e, y) ((e)->rows + (y) * row_words((e)->width))
+#define engine_slots(e) \
+	((unsigned char *)((e)->rows + (e)->height * row_words((e)->width)))
+#define engine_color(e, x, y) \
+	(engine_slots(e)[(e)->height + engine_slots(e)[y] * (e)->width + (x)])
+#define engine_bytes(width, height) \
+	(offsetof(struct engine_t, rows) + board_bytes(width, height))
+#define engine_size(e) engine_bytes((e)->width, (e)->height)
+#define engine_standard_size engine_bytes(board_width, board_height)
+/* the memory a game of this size is initialized in */
+#define engine_alloc_size(width, height) \
+	(engine_bytes(width, height) > sizeof(struct engine_t) \
+	 ? engine_bytes(width, height) : sizeof(struct engine_t))
+
+/* a game on the standard board */
+void engine_init(struct engine_t *e, unsigned int seed,
+				 enum randomizer_t randomizer);
+/* width and height must be within the board minimum and maximum, e must
+ * have engine_alloc_size() bytes
+ */
+void engine_init_size(struct engine_t *e, unsigned int seed,
+					  enum randomizer_t randomizer, int width, int height);
+void engine_copy(struct engine_t *dst, const struct engine_t *src);
+/* a state read from a file is one the engine can go on from: pieces,
+ * kinds and gravity in range, every row in a slot of its own, no cells
+ * past the width and heights that match the rows
+ */
+int engine_valid(const struct engine_t *e);
+int engine_step(struct engine_t *e, enum engine_input in);
+int engine_collides(const struct engine_t *e, int which, int x, int y);
+int engine_drop_distance(const struct engine_t *e, const struct piece_t *p);
+/* empty cells with an occupied one above them */
+int engine_holes(const struct engine_t *e);
+
+/* The parts of landing a piece, for bots and benchmarks. engine_step() does
+ * all three on lock: engine_lock() puts the current piece on the board,
+ * engine_clear_lines() removes the lines it filled and returns their number,
+ * engine_spawn() makes the next piece current and returns 0 on game over.
+ */
+void engine_lock(struct engine_t *e);
+/* after rows and colors were set by hand */
+void engine_rebuild(struct engine_t *e);
+int engine_clear_lines(struct engine_t *e);
+int engine_spawn(struct engine_t *e);
+
+#endif
@@ -0,0 +1,273 @@
+/* The code of engine.c that depends on the board size, included once for
+ * the standard board with the sizes as constants and once for any size,
+ * where they are read from the game. Before including define board_w and
+ * board_h (they may use e, every function here has the game as e) and
+ * board_fn(name) to name the functions of this size.
+ */
+
+#define board_words row_words(board_w)
+#define board_row(e, y) ((e)->rows + (y) * board_words)
+#define board_slot(e) ((unsigned char *)((e)->rows + board_h * board_words))
+#define board_color(e) (board_slot(e) + board_h)
+/* the word of column x and its bit, folded to the one word of narrow rows */
+#define board_word(x) (board_words > 1 ? (x) / 32 : 0)
+#define board_bit(x) (board_words > 1 ? (x) % 32 : (x))
+#define board_full(e, y) (board_words > 1 \
+	? rows_full(board_row(e, y), board_w) \
+	: board_row(e, y)[0] == row_mask(board_w))
+
+/* one memcpy, of a constant size on the standard board */
+static void board_fn(copy)(struct engine_t *dst, const struct engine_t *e)
+{
+	memcpy(dst, e, offsetof(struct engine_t, rows)
+		   + board_h * (board_words * sizeof(row_t) + 1 + board_w));
+}
+
+static int board_fn(is_collision)(const struct engine_t *e, int which,
+								  int dx, int dy)
+{
+	const row_t *row;
+	int i, shift = dx + piece_min_x[which], bit;
+
+	if (shift < 0 || dx + piece_max_x[which] >= board_w
+		|| dy + piece_height[which] > board_h)
+		return 1;
+
+	/* there is no top border, pieces only ever move down */
+	bit = board_bit(shift);
+	for (i = 0; i < piece_height[which]; i++) {
+		if (dy+i < 0)
+			continue;
+		row = board_row(e, dy+i) + board_word(shift);
+		if (row[0] & (piece_rows[which][i] << bit))
+			return 1;
+		/* 4 cells wide at most, a piece reaches into one more word */
+		if (board_words > 1 && bit > 32 - piece_span
+			&& (piece_rows[which][i] >> (32 - bit))
+			&& (row[1] & (piece_rows[which][i] >> (32 - bit))))
+			return 1;
+	}
+
+	return 0;
+}
+
+/* Rows the piece can fall. The heights give it directly as long as the piece
+ * is above the stack in every column, a piece moved under an overhang falls
+ * back to collision checks.
+ */
+static int board_fn(drop_distance)(const struct engine_t *e,
+								   const struct piece_t *p)
+{
+	int i, d = board_h, x = p->x + piece_min_x[p->which];
+
+	for (i = 0; i <= piece_max_x[p->which] - piece_min_x[p->which]; i++) {
+		int surface = board_h - e->heights[x+i];
+		int bottom = p->y + piece_bottom[p->which][i];
+
+		if (bottom >= surface) {
+			d = 0;
+			while (!board_fn(is_collision)(e, p->which, p->x, p->y+d+1))
+				d++;
+			return d;
+		}
+		if (surface-1 - bottom < d)
+			d = surface-1 - bottom;
+	}
+
+	return d;
+}
+
+/* word by word, down to the row where all of its columns were seen */
+static void board_fn(update_heights)(struct engine_t *e)
+{
+	row_t seen, fresh, all;
+	int w, x, y;
+
+	memset(e->heights, 0, sizeof(e->heights[0]) * board_w);
+	for (w = 0; w < board_words; w++) {
+		all = w < board_words-1 ? ~(row_t)0 : row_mask(board_w - 32*w);
+		seen = 0;
+		for (y = 0; y < board_h && seen != all; y++) {
+			fresh = board_row(e, y)[w] & ~seen;
+			seen |= fresh;
+			for (x = 32*w; fresh; x++, fresh >>= 1)
+				if (fresh & 1)
+					e->heights[x] = (unsigned char)(board_h - y);
+		}
+	}
+}
+
+static void board_fn(new_tetromino)(struct engine_t *e, struct piece_t *p)
+{
+	if (e->randomizer == randomizer_uniform)
+		p->which = next_random(e) % tetromino_count;
+	else
+		p->which = next_kind(e) * 4 + next_random(e) % 4;
+
+	/* keep the widest tetromino inside the board */
+	p->x = next_random(e) % (board_w - piece_span + 1);
+	p->y = 0;
+}
+
+/* Only the n rows from top down can have been filled by the last lock.
+ * Rows above the removed ones move down over them, a row is its words of
+ * occupancy and one slot of colors, and the freed slots become the empty
+ * rows on top of the stack.
+ */
+static void board_fn(remove_full_lines)(struct engine_t *e, int top, int n)
+{
+	int full[4], y, dst, i, w, k = 0, stack_top = board_h;
+	unsigned char freed[4];
+
+	for (y = top+n-1; y >= top && y >= 0; y--)
+		if (board_full(e, y))
+			full[k++] = y;
+
+	e->lines = k;
+	if (!k)
+		return;
+
+	/* rows above the highest column are empty and stay where they are */
+	for (i = 0; i < board_w; i++)
+		if (board_h - e->heights[i] < stack_top)
+			stack_top = board_h - e->heights[i];
+
+	dst = full[0];
+	for (y = full[0], i = 0; y >= stack_top; y--) {
+		if (i < k && y == full[i]) {
+			freed[i++] = board_slot(e)[y];
+			continue;
+		}
+		for (w = 0; w < board_words; w++)
+			board_row(e, dst)[w] = board_row(e, y)[w];
+		board_slot(e)[dst] = board_slot(e)[y];
+		dst--;
+	}
+	for (i = 0; i < k; i++, dst--) {
+		for (w = 0; w < board_words; w++)
+			board_row(e, dst)[w] = 0;
+		board_slot(e)[dst] = freed[i];
+		memset(board_color(e) + freed[i] * board_w, 0, board_w);
+	}
+
+	board_fn(update_heights)(e);
+	e->score += e->lines * 100;
+	e->cleared += e->lines;
+}
+
+static void board_fn(lock_tetromino)(struct engine_t *e)
+{
+	int i, w = e->curr.which;
+
+	for (i = 0; i < 4; i++) {
+		int x = tetromines[w].blocks[i].x + e->curr.x;
+		int y = tetromines[w].blocks[i].y + e->curr.y;
+
+		if (y >= 0) {
+			board_row(e, y)[board_word(x)] |= 1u << board_bit(x);
+			board_color(e)[board_slot(e)[y] * board_w + x] =
+				(unsigned char)(piece_kind(w) + 1);
+			if (board_h - y > e->heights[x])
+				e->heights[x] = (unsigned char)(board_h - y);
+		}
+	}
+	e->pieces++;
+}
+
+static int board_fn(clear_lines)(struct engine_t *e)
+{
+	board_fn(remove_full_lines)(e, e->curr.y,
+								piece_height[e->curr.which]);
+	return e->lines;
+}
+
+static int board_fn(spawn)(struct engine_t *e)
+{
+	e->curr = e->next;
+	board_fn(new_tetromino)(e, &e->next);
+	if (board_fn(is_collision)(e, e->curr.which, e->curr.x, e->curr.y)) {
+		e->game_over = 1;
+		return 0;
+	}
+	return 1;
+}
+
+static int board_fn(rotate_tetromino)(struct engine_t *e)
+{
+	int w = piece_next[e->curr.which];
+
+	if (board_fn(is_collision)(e, w, e->curr.x, e->curr.y))
+		return 0;
+
+	e->curr.which = w;
+	return 1;
+}
+
+static int board_fn(move_tetromino)(struct engine_t *e, int dx, int dy)
+{
+	if (board_fn(is_collision)(e, e->curr.which, e->curr.x+dx, e->curr.y+dy))
+		return 0;
+
+	e->curr.x += dx;
+	e->curr.y += dy;
+	return 1;
+}
+
+static int board_fn(land_tetromino)(struct engine_t *e)
+{
+	int res = step_locked;
+
+	board_fn(lock_tetromino)(e);
+	if (board_fn(clear_lines)(e))
+		res |= step_lines;
+	if (!board_fn(spawn)(e))
+		res |= step_game_over;
+
+	return res;
+}
+
+static int board_fn(step)(struct engine_t *e, enum engine_input in)
+{
+	int d, res = 0;
+
+	switch (in) {
+	case input_none:
+		break;
+	case input_left:
+		res = board_fn(move_tetromino)(e, -1, 0) ? step_moved : 0;
+		break;
+	case input_right:
+		res = board_fn(move_tetromino)(e, 1, 0) ? step_moved : 0;
+		break;
+	case input_down:
+		res = board_fn(move_tetromino)(e, 0, 1) ? step_moved : 0;
+		break;
+	case input_rotate:
+		res = board_fn(rotate_tetromino)(e) ? step_moved : 0;
+		break;
+	case input_drop:
+		d = board_fn(drop_distance)(e, &e->curr);
+		e->curr.y += d;
+		res = board_fn(land_tetromino)(e) | (d ? step_moved : 0);
+		break;
+	case input_tick:
+		d = board_fn(drop_distance)(e, &e->curr);
+		if (!d) {
+			res = board_fn(land_tetromino)(e);
+			break;
+		}
+		e->curr.y += d < e->gravity ? d : e->gravity;
+		res = step_moved;
+		break;
+	}
+
+	return res;
+}
+
+#undef board_words
+#undef board_row
+#undef board_slot
+#undef board_color
+#undef board_word
+#undef board_bit
+#undef board_full
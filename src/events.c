@@ -0,0 +1,236 @@
+#include <string.h> /* memcpy, strlen */
+#include <time.h> /* nanosleep */
+#include <errno.h> /* errno */
+#include <unistd.h> /* write, close */
+#include <fcntl.h> /* open */
+#include <sys/stat.h> /* stat */
+#include <sys/socket.h> /* socket, connect, setsockopt */
+#include <sys/time.h> /* timeval */
+#include <sys/un.h> /* sockaddr_un */
+#include <signal.h> /* sigemptyset, sigaddset */
+#include <pthread.h>
+#include "ring.h"
+#include "events.h"
+
+/* header: "TTEV" u16 version u16 record size u16 board width
+ *         u16 board height
+ * record: u64 ns u32 piece s32 value s16 x s16 y u8 kind u8 which
+ *         u8 input u8 lines
+ * All numbers are little endian.
+ */
+
+enum { events_version = 1, events_header_size = 12, events_record_size = 24 };
+
+/* the writer sleeps events_nap_ms when the ring is empty, the game never
+ * wakes it
+ */
+enum { events_ring_size = 1 << 20, events_nap_ms = 10,
+	   events_batch = 512 };
+
+/* a socket write gives up after events_linger_ms, and tries again unless
+ * the game is over, so a consumer that stops reading cannot hold up the
+ * exit for longer
+ */
+enum { events_linger_ms = 1000 };
+
+static const char events_magic[4] = "TTEV";
+
+struct events_t {
+	struct ring_t ring;
+	int fd;
+	pthread_t thread;
+	volatile int quit;
+	int failed;
+	unsigned long lost;		/* game thread: not reported in the ring yet */
+	unsigned long lost_total;
+	unsigned char out[events_batch * events_record_size];
+};
+
+static struct events_t events;
+
+static unsigned char *put_u16(unsigned char *p, unsigned int v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	return p + 2;
+}
+
+static unsigned char *put_u32(unsigned char *p, unsigned long v)
+{
+	p = put_u16(p, v & 0xffff);
+	return put_u16(p, (v >> 16) & 0xffff);
+}
+
+static unsigned char *put_record(unsigned char *p, const struct event_t *ev)
+{
+	p = put_u32(p, (unsigned long)(ev->ns & 0xffffffff));
+	p = put_u32(p, (unsigned long)(ev->ns >> 32));
+	p = put_u32(p, ev->piece);
+	p = put_u32(p, (unsigned long)ev->value);
+	p = put_u16(p, (unsigned int)ev->x);
+	p = put_u16(p, (unsigned int)ev->y);
+	*p++ = ev->kind;
+	*p++ = ev->which;
+	*p++ = ev->input;
+	*p++ = ev->lines;
+	return p;
+}
+
+static void write_all(struct events_t *s, const unsigned char *buf, int len)
+{
+	int n, done = 0;
+
+	while (!s->failed && done < len) {
+		n = write(s->fd, buf + done, len - done);
+		if (n < 0) {
+			if (errno == EINTR
+				|| ((errno == EAGAIN || errno == EWOULDBLOCK) && !s->quit))
+				continue;
+			s->failed = 1;
+			break;
+		}
+		done += n;
+	}
+}
+
+/* a consumer that goes away stops the writing, not the draining, so the
+ * game goes on as if nothing happened
+ */
+static void *write_events(void *arg)
+{
+	struct events_t *s = arg;
+	struct event_t ev;
+	struct timespec nap;
+	sigset_t mask;
+	unsigned char *p;
+	int quit;
+
+	/* a reader of the socket that goes away fails write(), it does not
+	 * kill the game
+	 */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+	nap.tv_sec = 0;
+	nap.tv_nsec = events_nap_ms * 1000000L;
+	for (;;) {
+		/* everything published before quit is in the ring */
+		quit = s->quit;
+		__sync_synchronize();
+		while (ring_used(&s->ring) >= sizeof(ev)) {
+			p = s->out;
+			while (p < s->out + sizeof(s->out)
+				   && ring_used(&s->ring) >= sizeof(ev)) {
+				ring_read(&s->ring, &ev, sizeof(ev));
+				p = put_record(p, &ev);
+			}
+			write_all(s, s->out, (int)(p - s->out));
+		}
+		if (quit)
+			break;
+		nanosleep(&nap, NULL);
+	}
+	return NULL;
+}
+
+/* a listening Unix socket is connected to, anything else is a file */
+static int open_output(const char *path)
+{
+	struct sockaddr_un addr;
+	struct timeval linger;
+	struct stat st;
+	int fd;
+
+	if (stat(path, &st) != 0 || !S_ISSOCK(st.st_mode))
+		return open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	linger.tv_sec = events_linger_ms / 1000;
+	linger.tv_usec = events_linger_ms % 1000 * 1000;
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0
+		|| setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &linger,
+					  sizeof(linger)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int events_open(const char *path, int width, int height)
+{
+	unsigned char header[events_header_size], *p = header;
+
+	events.fd = open_output(path);
+	if (events.fd < 0)
+		return 0;
+	if (!ring_init(&events.ring, events_ring_size)) {
+		close(events.fd);
+		errno = ENOMEM;
+		return 0;
+	}
+	events.quit = 0;
+	events.failed = 0;
+	events.lost = events.lost_total = 0;
+
+	memcpy(p, events_magic, 4);
+	p = put_u16(p + 4, events_version);
+	p = put_u16(p, events_record_size);
+	p = put_u16(p, (unsigned int)width);
+	put_u16(p, (unsigned int)height);
+	write_all(&events, header, sizeof(header));
+	if (events.failed || pthread_create(&events.thread, NULL, write_events,
+										&events) != 0) {
+		ring_free(&events.ring);
+		close(events.fd);
+		return 0;
+	}
+	return 1;
+}
+
+void events_push(const struct event_t *ev)
+{
+	struct event_t lost;
+
+	/* the loss is told before the events after it */
+	if (events.lost) {
+		if (ring_room(&events.ring) < 2 * sizeof(*ev)) {
+			events.lost++;
+			events.lost_total++;
+			return;
+		}
+		lost = *ev;
+		lost.kind = event_lost;
+		lost.value = (long)events.lost;
+		ring_write(&events.ring, &lost, sizeof(lost));
+		events.lost = 0;
+	}
+	if (!ring_write(&events.ring, ev, sizeof(*ev))) {
+		events.lost++;
+		events.lost_total++;
+	}
+}
+
+void events_publish()
+{
+	ring_publish(&events.ring);
+}
+
+int events_close(unsigned long *lost)
+{
+	__sync_synchronize();
+	events.quit = 1;
+	pthread_join(events.thread, NULL);
+	ring_free(&events.ring);
+	*lost = events.lost_total;
+	return close(events.fd) == 0 && !events.failed;
+}
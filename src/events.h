@@ -0,0 +1,51 @@
+#ifndef SENTRY_H_EVENTS
+#define SENTRY_H_EVENTS
+
+#include <stdint.h> /* uint64_t */
+
+/* --events: what happens in the game as fixed-size binary records, for
+ * analytics. The game thread only copies each event into a ring, nothing
+ * is allocated and nothing waits; a writer thread encodes the records and
+ * writes them to a file or a Unix socket. An event the ring has no room for
+ * is counted, and the count goes out as an event_lost once there is room.
+ */
+
+enum event_kind {
+	event_spawn = 1,	/* a piece enters the board */
+	event_move,			/* the piece moved: left, right or down */
+	event_rotate,
+	event_lock,			/* the piece where it landed */
+	event_lines,		/* lines removed, value is the points for them */
+	event_score,		/* value is the new score */
+	event_game_over,	/* value is the final score */
+	event_lost			/* value events were dropped before this one */
+};
+
+struct event_t {
+	uint64_t ns;			/* monotonic clock, see gravity_now() */
+	unsigned long piece;	/* number of the piece, from 0 */
+	long value;
+	int x, y;				/* of the piece */
+	unsigned char kind;		/* enum event_kind */
+	unsigned char which;	/* tetromino of the piece */
+	unsigned char input;	/* enum engine_input that made the event */
+	unsigned char lines;	/* lines removed by the lock, 0 before it */
+};
+
+/* writes the header with the board size and starts the writer, path is a
+ * file to create or a listening Unix socket; returns 0 with errno set on
+ * failure
+ */
+int events_open(const char *path, int width, int height);
+/* queues the event for the next events_publish(), counts it as lost if
+ * the ring is full
+ */
+void events_push(const struct event_t *ev);
+/* the writer sees the events pushed so far */
+void events_publish();
+/* returns once everything is written, 0 if a write failed; lost is the
+ * number of events dropped in the whole game
+ */
+int events_close(unsigned long *lost);
+
+#endif
@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdlib.h> /* exit */
+#include "engine.h"
+
+/* Writes piece_tables.h to stdout: the metadata of every orientation in
+ * tetromino.c, one array per field. The blocks are checked first, a table
+ * that cannot be right stops the build.
+ */
+
+static int min_x[tetromino_count], max_x[tetromino_count];
+static int height[tetromino_count];
+static unsigned int rows[tetromino_count][4];
+static int bottom[tetromino_count][4];
+static int next[tetromino_count];
+static int preview_x[tetromino_count], preview_y[tetromino_count];
+
+static void fail(int w, const char *msg)
+{
+	fprintf(stderr, "gen_tables: tetromino %d: %s\n", w, msg);
+	exit(1);
+}
+
+/* bit y*4 + x of the blocks moved to the top left corner */
+static unsigned int shape_of(const struct block_t *blocks)
+{
+	unsigned int shape = 0;
+	int i, x0 = 4, y0 = 4;
+
+	for (i = 0; i < 4; i++) {
+		if (blocks[i].x < x0)
+			x0 = blocks[i].x;
+		if (blocks[i].y < y0)
+			y0 = blocks[i].y;
+	}
+	for (i = 0; i < 4; i++)
+		shape |= 1u << ((blocks[i].y - y0) * 4 + blocks[i].x - x0);
+	return shape;
+}
+
+/* b is a turned a quarter either way */
+static int is_quarter_turn(int a, int b)
+{
+	struct block_t cw[4], ccw[4];
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		cw[i].x = -tetromines[a].blocks[i].y;
+		cw[i].y = tetromines[a].blocks[i].x;
+		ccw[i].x = tetromines[a].blocks[i].y;
+		ccw[i].y = -tetromines[a].blocks[i].x;
+	}
+	return shape_of(cw) == shape_of(tetromines[b].blocks)
+		|| shape_of(ccw) == shape_of(tetromines[b].blocks);
+}
+
+static void make_meta(int w)
+{
+	const struct block_t *b = tetromines[w].blocks;
+	int i, j, top = 4;
+
+	min_x[w] = 4;
+	max_x[w] = -1;
+	for (i = 0; i < 4; i++) {
+		if (b[i].x < 0 || b[i].x > 3 || b[i].y < 0 || b[i].y > 3)
+			fail(w, "a block is out of the 4x4 box");
+		for (j = 0; j < i; j++)
+			if (b[j].x == b[i].x && b[j].y == b[i].y)
+				fail(w, "two blocks are in one cell");
+		if (b[i].x < min_x[w])
+			min_x[w] = b[i].x;
+		if (b[i].x > max_x[w])
+			max_x[w] = b[i].x;
+		if (b[i].y < top)
+			top = b[i].y;
+		if (b[i].y+1 > height[w])
+			height[w] = b[i].y+1;
+	}
+	/* the engine counts the rows of a piece from its top */
+	if (top != 0)
+		fail(w, "the top row has no block");
+
+	for (i = 0; i < 4; i++)
+		bottom[w][i] = -1;
+	for (i = 0; i < 4; i++) {
+		rows[w][b[i].y] |= 1u << (b[i].x - min_x[w]);
+		if (b[i].y > bottom[w][b[i].x - min_x[w]])
+			bottom[w][b[i].x - min_x[w]] = b[i].y;
+	}
+	for (i = 0; i <= max_x[w] - min_x[w]; i++)
+		if (bottom[w][i] < 0)
+			fail(w, "a column between the blocks is empty");
+
+	next[w] = (w+1) % 4 == 0 ? w-3 : w+1;
+
+	/* the next-piece box is 4x4 cells, smaller pieces move in by a cell */
+	preview_x[w] = max_x[w] > 1 ? 0 : 1;
+	preview_y[w] = height[w] > 3 ? 0 : 1;
+}
+
+static void print_ints(const char *type, const char *name, const int *v)
+{
+	int w;
+
+	printf("static const %s %s[tetromino_count] = {", type, name);
+	for (w = 0; w < tetromino_count; w++)
+		printf("%s%s%d", w ? "," : "", w % 14 ? " " : "\n\t", v[w]);
+	printf("\n};\n\n");
+}
+
+static void print_quads(const char *type, const char *name, const char *fmt,
+						unsigned int (*u)[4], int (*v)[4])
+{
+	int w, i;
+
+	printf("static const %s %s[tetromino_count][4] = {\n", type, name);
+	for (w = 0; w < tetromino_count; w++) {
+		printf("\t{ ");
+		for (i = 0; i < 4; i++) {
+			printf(fmt, u ? (int)u[w][i] : v[w][i]);
+			printf(i < 3 ? ", " : " }");
+		}
+		printf(w < tetromino_count-1 ? ",\n" : "\n");
+	}
+	printf("};\n\n");
+}
+
+int main()
+{
+	int w, span = 0, tallest = 0;
+
+	for (w = 0; w < tetromino_count; w++)
+		make_meta(w);
+	for (w = 0; w < tetromino_count; w++) {
+		if (!is_quarter_turn(w, next[w]))
+			fail(w, "the next orientation is not a quarter turn of it");
+		if (max_x[w]+1 > span)
+			span = max_x[w]+1;
+		if (height[w] > tallest)
+			tallest = height[w];
+	}
+	if (span > board_min_width || tallest > board_min_height)
+		fail(0, "the pieces do not fit on the smallest board");
+
+	printf("#ifndef SENTRY_H_PIECE_TABLES\n"
+		   "#define SENTRY_H_PIECE_TABLES\n\n"
+		   "/* Generated by gen_tables from tetromino.c, do not edit. "
+		   "Include after\n * engine.h.\n */\n\n"
+		   "/* columns from x = 0 that every orientation fits in */\n"
+		   "enum { piece_span = %d };\n\n", span);
+	printf("/* checked by the compiler: the tables are of this tetromino.h "
+		   "and fit the\n * smallest board\n */\n"
+		   "typedef char piece_tables_count_check"
+		   "[tetromino_count == %d ? 1 : -1];\n"
+		   "typedef char piece_tables_span_check"
+		   "[(int)piece_span <= (int)board_min_width ? 1 : -1];\n\n",
+		   tetromino_count);
+
+	printf("/* the bounding box: columns of the leftmost and the rightmost "
+		   "block, rows\n * from the top\n */\n");
+	print_ints("signed char", "piece_min_x", min_x);
+	print_ints("signed char", "piece_max_x", max_x);
+	print_ints("signed char", "piece_height", height);
+	printf("/* rows of the blocks, bit 0 is column piece_min_x */\n");
+	print_quads("row_t", "piece_rows", "0x%x", rows, NULL);
+	printf("/* lowest block of each column from piece_min_x, -1 past the "
+		   "piece */\n");
+	print_quads("signed char", "piece_bottom", "%2d", NULL, bottom);
+	printf("/* the orientation a rotation turns to */\n");
+	print_ints("unsigned char", "piece_next", next);
+	printf("/* cells the next-piece box moves the piece right and down */\n");
+	print_ints("unsigned char", "piece_preview_x", preview_x);
+	print_ints("unsigned char", "piece_preview_y", preview_y);
+	printf("#endif\n");
+
+	return 0;
+}
@@ -0,0 +1,82 @@
+#if FOR_WINDOWS
+#include <Windows.h> /* QueryPerformanceCounter */
+#else
+#include <time.h> /* clock_gettime */
+#endif
+#include "engine.h"
+#include "gravity.h"
+
+enum { ns_per_ms = 1000000, ns_per_sec = 1000000000 };
+
+/* the guideline interval of levels 0..19, ns; the levels after 19 keep the
+ * last one
+ */
+static const unsigned long guideline_ns[] = {
+	1000000000, 793000000, 617796000, 472729139, 355196928,
+	262003550, 189677245, 134734731, 93882249, 64151585,
+	42976258, 28217678, 18153329, 11439342, 7058616,
+	4263557, 2520084, 1457139, 823907, 455398
+};
+
+enum { guideline_levels = sizeof(guideline_ns) / sizeof(guideline_ns[0]) };
+
+const char *const curve_names[curve_count] = { "fixed", "guideline" };
+
+#if FOR_WINDOWS
+
+uint64_t gravity_now()
+{
+	LARGE_INTEGER c, f;
+	uint64_t count, freq;
+
+	QueryPerformanceCounter(&c);
+	QueryPerformanceFrequency(&f);
+	count = (uint64_t)c.QuadPart;
+	freq = (uint64_t)f.QuadPart;
+	/* count * ns_per_sec would overflow within hours */
+	return count / freq * ns_per_sec + count % freq * ns_per_sec / freq;
+}
+
+#else
+
+uint64_t gravity_now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * ns_per_sec + (uint64_t)ts.tv_nsec;
+}
+
+#endif
+
+unsigned long gravity_interval(int curve, int level)
+{
+	if (curve != curve_guideline)
+		return (unsigned long)fall_delay * ns_per_ms;
+	if (level >= guideline_levels)
+		level = guideline_levels-1;
+	return guideline_ns[level];
+}
+
+void gravity_start(struct gravity_t *g, int curve, const struct engine_t *e,
+				   uint64_t now)
+{
+	g->curve = curve;
+	g->deadline = now + gravity_interval(curve, engine_level(e));
+	g->left = 0;
+}
+
+void gravity_next(struct gravity_t *g, const struct engine_t *e)
+{
+	g->deadline += gravity_interval(g->curve, engine_level(e));
+}
+
+void gravity_pause(struct gravity_t *g, uint64_t now)
+{
+	g->left = g->deadline > now ? g->deadline - now : 0;
+}
+
+void gravity_resume(struct gravity_t *g, uint64_t now)
+{
+	g->deadline = now + g->left;
+}
@@ -0,0 +1,43 @@
+#ifndef SENTRY_H_GRAVITY
+#define SENTRY_H_GRAVITY
+
+#include <stdint.h> /* uint64_t */
+#include "engine.h"
+
+/* Gravity pace. Every fall step has an absolute deadline on the monotonic
+ * clock and the next one is that deadline plus the interval of the level,
+ * so a late wakeup takes nothing from the steps after it and a long game
+ * keeps the pace of its curve on any machine.
+ */
+
+enum { fall_delay = 500 };	/* ms between gravity steps of curve_fixed */
+
+enum gravity_curve {
+	curve_fixed,		/* fall_delay ms at every level */
+	curve_guideline,	/* (0.8 - 0.007 level)^level s, 1 s to 0.46 ms */
+	curve_count
+};
+
+struct gravity_t {
+	int curve;			/* enum gravity_curve */
+	uint64_t deadline;	/* ns of the next fall step */
+	uint64_t left;		/* ns from the pause to the deadline */
+};
+
+extern const char *const curve_names[curve_count];
+
+/* ns of the monotonic clock */
+uint64_t gravity_now();
+/* ns between two fall steps at the level */
+unsigned long gravity_interval(int curve, int level);
+/* the first fall step is an interval of the game's level from now */
+void gravity_start(struct gravity_t *g, int curve, const struct engine_t *e,
+				   uint64_t now);
+/* the step at the deadline was made, the next one follows it */
+void gravity_next(struct gravity_t *g, const struct engine_t *e);
+void gravity_pause(struct gravity_t *g, uint64_t now);
+void gravity_resume(struct gravity_t *g, uint64_t now);
+
+#define gravity_due(g, now) ((g)->deadline <= (now))
+
+#endif
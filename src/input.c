@@ -0,0 +1,114 @@
+#include <unistd.h> /* read */
+#include "input.h"
+
+void input_init(struct input_t *in)
+{
+	in->state = input_ground;
+	in->head = 0;
+	in->count = 0;
+}
+
+static void push_key(struct input_t *in, int key)
+{
+	if (in->count == input_queue_size)
+		return;
+	in->keys[(in->head + in->count) % input_queue_size] = key;
+	in->count++;
+}
+
+/* the final byte of ESC [ ... or ESC O, the arrows are A..D with or
+ * without modifiers
+ */
+static void push_final(struct input_t *in, unsigned char c)
+{
+	switch (c) {
+	case 'A':
+		push_key(in, key_up);
+		break;
+	case 'B':
+		push_key(in, key_down);
+		break;
+	case 'C':
+		push_key(in, key_right);
+		break;
+	case 'D':
+		push_key(in, key_left);
+		break;
+	}
+}
+
+void input_feed(struct input_t *in, const unsigned char *buf, int len)
+{
+	unsigned char c;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		c = buf[i];
+		switch (in->state) {
+		case input_ground:
+			if (c == key_esc)
+				in->state = input_esc;
+			else
+				push_key(in, c);
+			break;
+		case input_esc:
+			if (c == '[')
+				in->state = input_csi;
+			else if (c == 'O')
+				in->state = input_ss3;
+			else if (c != key_esc) {
+				/* Esc and then another key */
+				push_key(in, key_esc);
+				push_key(in, c);
+				in->state = input_ground;
+			} else
+				push_key(in, key_esc);
+			break;
+		case input_csi:
+			/* parameters and intermediates up to the final byte */
+			if (c >= 0x40 && c <= 0x7e) {
+				push_final(in, c);
+				in->state = input_ground;
+			} else if (c < 0x20) {
+				/* not a sequence after all */
+				in->state = input_ground;
+				i--;
+			}
+			break;
+		case input_ss3:
+			push_final(in, c);
+			in->state = input_ground;
+			break;
+		}
+	}
+}
+
+int input_read(struct input_t *in, int fd)
+{
+	unsigned char buf[input_queue_size];
+	int n;
+
+	n = (int)read(fd, buf, input_room(in));
+	if (n > 0)
+		input_feed(in, buf, n);
+	return n;
+}
+
+int input_next(struct input_t *in)
+{
+	int key;
+
+	if (!in->count)
+		return -1;
+	key = in->keys[in->head];
+	in->head = (in->head + 1) % input_queue_size;
+	in->count--;
+	return key;
+}
+
+void input_timeout(struct input_t *in)
+{
+	if (in->state != input_ground)
+		push_key(in, key_esc);
+	in->state = input_ground;
+}
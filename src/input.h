@@ -0,0 +1,45 @@
+#ifndef SENTRY_H_INPUT
+#define SENTRY_H_INPUT
+
+/* Streaming key decoder. Bytes go in as the terminal sends them, in reads
+ * of any size: a plain byte is a key of its own, an escape sequence is one
+ * key however the reads split it, and the sequences the game has no use
+ * for are skipped. The keys wait in a queue for the loop to take them all.
+ */
+
+enum { key_esc = 27, key_space = 32,
+	   key_up = 0x100, key_down, key_right, key_left };
+
+/* a read never takes more bytes than the queue has room for keys; an ESC
+ * with nothing after it for input_esc_ms is the Esc key
+ */
+enum { input_queue_size = 256, input_esc_ms = 25 };
+
+enum input_state {
+	input_ground,
+	input_esc,			/* after ESC */
+	input_csi,			/* after ESC [ */
+	input_ss3			/* after ESC O */
+};
+
+struct input_t {
+	enum input_state state;
+	int keys[input_queue_size];
+	int head, count;
+};
+
+void input_init(struct input_t *in);
+/* len must not be more than input_room() */
+void input_feed(struct input_t *in, const unsigned char *buf, int len);
+/* reads what fd has, at most input_room() bytes; returns what read() does */
+int input_read(struct input_t *in, int fd);
+/* the next key, -1 when the queue is empty */
+int input_next(struct input_t *in);
+/* the sequence begun is not coming, ESC is a key then */
+void input_timeout(struct input_t *in);
+
+#define input_room(in) (input_queue_size - (in)->count)
+/* in the middle of a sequence, the rest may be in the next read */
+#define input_waiting(in) ((in)->state != input_ground)
+
+#endif
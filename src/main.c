@@ -1,17 +1,246 @@
+#include <stdio.h>
+#include <stdlib.h> /* atoi, strtoul, strtol */
+#include <string.h> /* strcmp */
+#include "engine.h"
+#include "replay.h"
+#include "gravity.h"
 #include "tetris.h"
+#include "server.h"
 
-int main()
+static void usage(const char *name)
 {
+	fprintf(stderr, "usage: %s [--gravity rows|20G] [--curve fixed|guideline]\n"
+			"       [--wakeups] [--record file] [--width cells] "
+			"[--height cells]\n"
+			"       [--seed n] [--randomizer uniform|bag|history] "
+			"[--autoplay] [--stats file]\n"
+			"       [--cast file] [--events path] [--save file] "
+			"[--resume file]\n", name);
+	fprintf(stderr, "       %s --replay file [--seek piece] [--headless] "
+			"[--cast file]\n"
+			"       [--events path]\n"
+			"       %s --server socket [--gravity rows|20G] [--seed n] "
+			"[--randomizer name]\n"
+			"       [--curve name] [--width cells] [--height cells]\n"
+			"       %s --connect socket [--watch game]\n",
+			name, name, name);
+}
+
+static int parse_args(int argc, char **argv, struct game_options_t *opts)
+{
+	int i, r;
+
+	opts->gravity = 1;
+	opts->curve = curve_fixed;
+	opts->width = board_width;
+	opts->height = board_height;
+	opts->wakeups = 0;
+	opts->record = NULL;
+	opts->replay = NULL;
+	opts->seek = 0;
+	opts->headless = 0;
+	opts->seed = 0;
+	opts->has_seed = 0;
+	opts->randomizer = randomizer_uniform;
+	opts->autoplay = 0;
+	opts->stats = NULL;
+	opts->cast = NULL;
+	opts->events = NULL;
+	opts->save = NULL;
+	opts->resume = NULL;
+	opts->server = NULL;
+	opts->connect = NULL;
+	opts->watch = -1;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--gravity") && i+1 < argc) {
+			i++;
+			if (!strcmp(argv[i], "20G") || !strcmp(argv[i], "20g"))
+				opts->gravity = board_max_height;
+			else
+				opts->gravity = atoi(argv[i]);
+			if (opts->gravity < 1) {
+				fprintf(stderr, "%s: bad gravity %s\n", argv[0], argv[i]);
+				return 0;
+			}
+			/* any more falls as far as 20G does */
+			if (opts->gravity > board_max_height)
+				opts->gravity = board_max_height;
+		} else if (!strcmp(argv[i], "--curve") && i+1 < argc) {
+			i++;
+			for (r = 0; r < curve_count; r++)
+				if (!strcmp(argv[i], curve_names[r]))
+					break;
+			if (r == curve_count) {
+				fprintf(stderr, "%s: bad curve %s\n", argv[0], argv[i]);
+				return 0;
+			}
+			opts->curve = r;
+		} else if (!strcmp(argv[i], "--width") && i+1 < argc) {
+			opts->width = atoi(argv[++i]);
+			if (opts->width < board_min_width
+				|| opts->width > board_max_width) {
+				fprintf(stderr, "%s: the width must be %d to %d\n", argv[0],
+						board_min_width, board_max_width);
+				return 0;
+			}
+		} else if (!strcmp(argv[i], "--height") && i+1 < argc) {
+			opts->height = atoi(argv[++i]);
+			if (opts->height < board_min_height
+				|| opts->height > board_max_height) {
+				fprintf(stderr, "%s: the height must be %d to %d\n", argv[0],
+						board_min_height, board_max_height);
+				return 0;
+			}
+		} else if (!strcmp(argv[i], "--wakeups")) {
+			opts->wakeups = 1;
+		} else if (!strcmp(argv[i], "--record") && i+1 < argc) {
+			opts->record = argv[++i];
+		} else if (!strcmp(argv[i], "--replay") && i+1 < argc) {
+			opts->replay = argv[++i];
+		} else if (!strcmp(argv[i], "--seek") && i+1 < argc) {
+			opts->seek = strtoul(argv[++i], NULL, 10);
+		} else if (!strcmp(argv[i], "--headless")) {
+			opts->headless = 1;
+		} else if (!strcmp(argv[i], "--server") && i+1 < argc) {
+			opts->server = argv[++i];
+		} else if (!strcmp(argv[i], "--connect") && i+1 < argc) {
+			opts->connect = argv[++i];
+		} else if (!strcmp(argv[i], "--watch") && i+1 < argc) {
+			opts->watch = strtol(argv[++i], NULL, 10);
+			if (opts->watch < 0 || opts->watch > 0xffffffffL) {
+				fprintf(stderr, "%s: bad game %s\n", argv[0], argv[i]);
+				return 0;
+			}
+		} else if (!strcmp(argv[i], "--autoplay")) {
+			opts->autoplay = 1;
+		} else if (!strcmp(argv[i], "--stats") && i+1 < argc) {
+#if TETRIS_STATS
+			opts->stats = argv[++i];
+#else
+			fprintf(stderr, "%s: --stats needs a build with make STATS=1\n",
+					argv[0]);
+			return 0;
+#endif
+		} else if (!strcmp(argv[i], "--cast") && i+1 < argc) {
+#if FOR_WINDOWS
+			fprintf(stderr, "%s: no --cast on Windows\n", argv[0]);
+			return 0;
+#else
+			opts->cast = argv[++i];
+#endif
+		} else if (!strcmp(argv[i], "--events") && i+1 < argc) {
 #if FOR_WINDOWS
+			fprintf(stderr, "%s: no --events on Windows\n", argv[0]);
+			return 0;
+#else
+			opts->events = argv[++i];
+#endif
+		} else if (!strcmp(argv[i], "--save") && i+1 < argc) {
+			opts->save = argv[++i];
+		} else if (!strcmp(argv[i], "--resume") && i+1 < argc) {
+			opts->resume = argv[++i];
+		} else if (!strcmp(argv[i], "--seed") && i+1 < argc) {
+			opts->seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+			opts->has_seed = 1;
+		} else if (!strcmp(argv[i], "--randomizer") && i+1 < argc) {
+			i++;
+			for (r = 0; r < randomizer_count; r++)
+				if (!strcmp(argv[i], randomizer_names[r]))
+					break;
+			if (r == randomizer_count) {
+				fprintf(stderr, "%s: bad randomizer %s\n", argv[0], argv[i]);
+				return 0;
+			}
+			opts->randomizer = r;
+		} else {
+			usage(argv[0]);
+			return 0;
+		}
+	}
+
+	/* the bot plays the standard board only */
+	if (opts->autoplay
+		&& (opts->width != board_width || opts->height != board_height)) {
+		fprintf(stderr, "%s: --autoplay needs the standard %dx%d board\n",
+				argv[0], board_width, board_height);
+		return 0;
+	}
+
+	if ((opts->record && opts->replay) || (opts->autoplay && opts->replay)
+		|| ((opts->server || opts->connect)
+			&& (opts->record || opts->replay || opts->autoplay || opts->cast
+				|| opts->events || opts->save || opts->resume))
+		|| (opts->replay && (opts->save || opts->resume))
+		|| (opts->resume && opts->record)
+		|| (opts->headless && (opts->cast || opts->events))
+		|| (opts->server && opts->connect)
+		|| (opts->watch >= 0 && !opts->connect)
+		|| (!opts->replay && (opts->seek || opts->headless))) {
+		usage(argv[0]);
+		return 0;
+	}
+
+	return 1;
+}
 
-	init_game_win();
+/* replays the game as fast as possible and prints how it ended */
+static int play_headless(const struct game_options_t *opts)
+{
+	struct replay_t replay;
+	struct replay_record_t rec;
+	struct engine_any_t room;
+	struct engine_t *game = &room.e;
+
+	if (!replay_open(&replay, opts->replay)) {
+		fprintf(stderr, "cannot read replay %s\n", opts->replay);
+		return 1;
+	}
+
+	engine_init_size(game, replay.seed, (enum randomizer_t)replay.randomizer,
+					 replay.width, replay.height);
+	game->gravity = replay.gravity;
+	if (!replay_seek(&replay, game, opts->seek)) {
+		fprintf(stderr, "the replay ends before piece %lu\n", opts->seek);
+		replay_close(&replay);
+		return 1;
+	}
+
+	while (!game->game_over && replay_next(&replay, &rec))
+		engine_step(game, rec.in);
+
+	printf("pieces: %lu\nscore: %d\ntime: %lu ms\ngame over: %s\n",
+		   game->pieces, game->score, replay.last_ms,
+		   game->game_over ? "yes" : "no");
+	replay_close(&replay);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct game_options_t opts;
+
+	if (!parse_args(argc, argv, &opts))
+		return 1;
+
+	if (opts.headless)
+		return play_headless(&opts);
+
+#if FOR_WINDOWS
+
+	init_game_win(&opts);
 	start_game_win();
 	restore_game_win();
 	return 0;
 
 #else
 
-	init_game();
+	if (opts.server)
+		return run_server(opts.server, &opts);
+	if (opts.connect)
+		return connect_game(opts.connect, opts.watch);
+
+	init_game(&opts);
 	start_game();
 	restore_game();
 	return 0;
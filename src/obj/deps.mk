@@ -0,0 +1,18 @@
+./obj/tetris.o: tetris.c engine.h tetromino.h bot.h render.h view.h replay.h \
+ save.h gravity.h input.h stats.h cast.h events.h tetris.h server.h
+./obj/render.o: render.c render.h
+./obj/view.o: view.c engine.h tetromino.h piece_tables.h render.h view.h
+./obj/server.o: server.c engine.h tetromino.h render.h view.h gravity.h input.h \
+ tetris.h server.h
+./obj/cast.o: cast.c ring.h cast.h
+./obj/events.o: events.c ring.h events.h
+./obj/ring.o: ring.c ring.h
+./obj/input.o: input.c input.h
+./obj/engine.o: engine.c engine.h tetromino.h rows.h piece_tables.h \
+ engine_board.h
+./obj/replay.o: replay.c engine.h tetromino.h replay.h
+./obj/bot.o: bot.c engine.h tetromino.h piece_tables.h bot.h
+./obj/save.o: save.c engine.h tetromino.h save.h
+./obj/gravity.o: gravity.c engine.h tetromino.h gravity.h
+./obj/rows.o: rows.c engine.h tetromino.h rows.h
+./obj/tetromino.o: tetromino.c tetromino.h
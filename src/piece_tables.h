@@ -0,0 +1,116 @@
+#ifndef SENTRY_H_PIECE_TABLES
+#define SENTRY_H_PIECE_TABLES
+
+/* Generated by gen_tables from tetromino.c, do not edit. Include after
+ * engine.h.
+ */
+
+/* columns from x = 0 that every orientation fits in */
+enum { piece_span = 4 };
+
+/* checked by the compiler: the tables are of this tetromino.h and fit the
+ * smallest board
+ */
+typedef char piece_tables_count_check[tetromino_count == 28 ? 1 : -1];
+typedef char piece_tables_span_check[(int)piece_span <= (int)board_min_width ? 1 : -1];
+
+/* the bounding box: columns of the leftmost and the rightmost block, rows
+ * from the top
+ */
+static const signed char piece_min_x[tetromino_count] = {
+	0, 0, 0, 0, 1, 0, 2, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+static const signed char piece_max_x[tetromino_count] = {
+	1, 1, 1, 1, 1, 3, 2, 3, 2, 1, 2, 1, 2, 1,
+	2, 1, 2, 1, 2, 1, 1, 2, 1, 2, 1, 2, 1, 2
+};
+
+static const signed char piece_height[tetromino_count] = {
+	2, 2, 2, 2, 4, 1, 4, 1, 2, 3, 2, 3, 2, 3,
+	2, 3, 2, 3, 2, 3, 3, 2, 3, 2, 3, 2, 3, 2
+};
+
+/* rows of the blocks, bit 0 is column piece_min_x */
+static const row_t piece_rows[tetromino_count][4] = {
+	{ 0x3, 0x3, 0x0, 0x0 },
+	{ 0x3, 0x3, 0x0, 0x0 },
+	{ 0x3, 0x3, 0x0, 0x0 },
+	{ 0x3, 0x3, 0x0, 0x0 },
+	{ 0x1, 0x1, 0x1, 0x1 },
+	{ 0xf, 0x0, 0x0, 0x0 },
+	{ 0x1, 0x1, 0x1, 0x1 },
+	{ 0xf, 0x0, 0x0, 0x0 },
+	{ 0x6, 0x3, 0x0, 0x0 },
+	{ 0x1, 0x3, 0x2, 0x0 },
+	{ 0x6, 0x3, 0x0, 0x0 },
+	{ 0x1, 0x3, 0x2, 0x0 },
+	{ 0x3, 0x6, 0x0, 0x0 },
+	{ 0x2, 0x3, 0x1, 0x0 },
+	{ 0x3, 0x6, 0x0, 0x0 },
+	{ 0x2, 0x3, 0x1, 0x0 },
+	{ 0x7, 0x2, 0x0, 0x0 },
+	{ 0x2, 0x3, 0x2, 0x0 },
+	{ 0x2, 0x7, 0x0, 0x0 },
+	{ 0x1, 0x3, 0x1, 0x0 },
+	{ 0x2, 0x2, 0x3, 0x0 },
+	{ 0x1, 0x7, 0x0, 0x0 },
+	{ 0x3, 0x1, 0x1, 0x0 },
+	{ 0x7, 0x4, 0x0, 0x0 },
+	{ 0x1, 0x1, 0x3, 0x0 },
+	{ 0x7, 0x1, 0x0, 0x0 },
+	{ 0x3, 0x2, 0x2, 0x0 },
+	{ 0x4, 0x7, 0x0, 0x0 }
+};
+
+/* lowest block of each column from piece_min_x, -1 past the piece */
+static const signed char piece_bottom[tetromino_count][4] = {
+	{  1,  1, -1, -1 },
+	{  1,  1, -1, -1 },
+	{  1,  1, -1, -1 },
+	{  1,  1, -1, -1 },
+	{  3, -1, -1, -1 },
+	{  0,  0,  0,  0 },
+	{  3, -1, -1, -1 },
+	{  0,  0,  0,  0 },
+	{  1,  1,  0, -1 },
+	{  1,  2, -1, -1 },
+	{  1,  1,  0, -1 },
+	{  1,  2, -1, -1 },
+	{  0,  1,  1, -1 },
+	{  2,  1, -1, -1 },
+	{  0,  1,  1, -1 },
+	{  2,  1, -1, -1 },
+	{  0,  1,  0, -1 },
+	{  1,  2, -1, -1 },
+	{  1,  1,  1, -1 },
+	{  2,  1, -1, -1 },
+	{  2,  2, -1, -1 },
+	{  1,  1,  1, -1 },
+	{  2,  0, -1, -1 },
+	{  0,  0,  1, -1 },
+	{  2,  2, -1, -1 },
+	{  1,  0,  0, -1 },
+	{  0,  2, -1, -1 },
+	{  1,  1,  1, -1 }
+};
+
+/* the orientation a rotation turns to */
+static const unsigned char piece_next[tetromino_count] = {
+	1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14,
+	15, 12, 17, 18, 19, 16, 21, 22, 23, 20, 25, 26, 27, 24
+};
+
+/* cells the next-piece box moves the piece right and down */
+static const unsigned char piece_preview_x[tetromino_count] = {
+	1, 1, 1, 1, 1, 0, 0, 0, 0, 1, 0, 1, 0, 1,
+	0, 1, 0, 1, 0, 1, 1, 0, 1, 0, 1, 0, 1, 0
+};
+
+static const unsigned char piece_preview_y[tetromino_count] = {
+	1, 1, 1, 1, 0, 1, 0, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1
+};
+
+#endif
@@ -0,0 +1,402 @@
+#if FOR_WINDOWS
+
+#include <stdio.h>
+
+#else
+
+#include <unistd.h> /* write */
+#include <errno.h> /* errno */
+
+#endif
+
+#include <stdlib.h> /* malloc, realloc */
+#include <string.h> /* memcmp */
+#include "render.h"
+
+static const struct cell_t blank_cell = { " ", default_font, default_back };
+
+static void fill_cells(struct cell_t *cells, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		cells[i] = blank_cell;
+}
+
+int render_init(struct render_t *r, int fd, int width, int height)
+{
+	memset(r, 0, sizeof(*r));
+	r->fd = fd;
+	r->width = width;
+	r->height = height;
+	r->back = malloc(width * height * sizeof(struct cell_t));
+	r->front = malloc(width * height * sizeof(struct cell_t));
+	r->out_cap = 4096;
+	r->out = malloc(r->out_cap);
+	if (!r->back || !r->front || !r->out) {
+		render_free(r);
+		return 0;
+	}
+
+	render_clear(r);
+	render_invalidate(r);
+	return 1;
+}
+
+void render_free(struct render_t *r)
+{
+	free(r->back);
+	free(r->front);
+	free(r->out);
+	r->back = r->front = NULL;
+	r->out = NULL;
+}
+
+int render_resize(struct render_t *r, int width, int height)
+{
+	struct cell_t *back, *front;
+
+	back = malloc(width * height * sizeof(struct cell_t));
+	front = malloc(width * height * sizeof(struct cell_t));
+	if (!back || !front) {
+		free(back);
+		free(front);
+		return 0;
+	}
+
+	free(r->back);
+	free(r->front);
+	r->back = back;
+	r->front = front;
+	r->width = width;
+	r->height = height;
+	render_clear(r);
+	/* the terminal has reflowed what it showed */
+	render_invalidate(r);
+	return 1;
+}
+
+void render_clear(struct render_t *r)
+{
+	fill_cells(r->back, r->width * r->height);
+	r->dirty_top = 0;
+	r->dirty_bottom = r->height-1;
+}
+
+void render_invalidate(struct render_t *r)
+{
+	r->invalid = 1;
+}
+
+/* every glyph takes one terminal column */
+static int glyph_len(const char *s)
+{
+	unsigned char c = (unsigned char)*s;
+
+	if (c < 0x80)
+		return 1;
+	if (c < 0xe0)
+		return 2;
+	if (c < 0xf0)
+		return 3;
+	return 4;
+}
+
+void render_text(struct render_t *r, int x, int y, const char *s,
+				 int fg, int bg)
+{
+	struct cell_t *c;
+	int n;
+
+	x--;
+	y--;
+	if (y < 0 || y >= r->height)
+		return;
+	if (y < r->dirty_top)
+		r->dirty_top = y;
+	if (y > r->dirty_bottom)
+		r->dirty_bottom = y;
+
+	for (; *s; s += n, x++) {
+		n = glyph_len(s);
+		if (x < 0)
+			continue;
+		if (x >= r->width)
+			break;
+
+		c = &r->back[y * r->width + x];
+		memset(c->ch, 0, sizeof(c->ch));
+		memcpy(c->ch, s, n);
+		c->fg = (unsigned char)fg;
+		c->bg = (unsigned char)bg;
+	}
+}
+
+/* a failure is remembered in no_room, what is drawn after it is dropped
+ * and the caller of the flush learns it at the end
+ */
+static int out_reserve(struct render_t *r, int n)
+{
+	char *p;
+	int cap = r->out_cap;
+
+	if (r->out_len + n <= cap)
+		return 1;
+	if (r->no_room)
+		return 0;
+
+	while (r->out_len + n > cap)
+		cap *= 2;
+	p = realloc(r->out, cap);
+	if (!p) {
+		r->no_room = 1;
+		return 0;
+	}
+	r->out = p;
+	r->out_cap = cap;
+	return 1;
+}
+
+static void out_str(struct render_t *r, const char *s, int n)
+{
+	if (!out_reserve(r, n))
+		return;
+	memcpy(r->out + r->out_len, s, n);
+	r->out_len += n;
+}
+
+static int num_len(int n)
+{
+	int len = 1;
+
+	while (n >= 10) {
+		n /= 10;
+		len++;
+	}
+	return len;
+}
+
+static char *put_num(char *p, int n)
+{
+	int i, len = num_len(n);
+
+	for (i = len; i > 0; i--, n /= 10)
+		p[i-1] = (char)('0' + n % 10);
+	return p + len;
+}
+
+/* ESC [ a ; b final, with b left out when it is below 0 */
+static void out_csi(struct render_t *r, int a, int b, char final)
+{
+	char *p;
+
+	if (!out_reserve(r, 32))
+		return;
+	p = r->out + r->out_len;
+	*p++ = '\x1b';
+	*p++ = '[';
+	p = put_num(p, a);
+	if (b >= 0) {
+		*p++ = ';';
+		p = put_num(p, b);
+	}
+	*p++ = final;
+	r->out_len = p - r->out;
+}
+
+static int cell_len(const struct cell_t *c)
+{
+	return c->ch[3] ? 4 : (int)strlen(c->ch);
+}
+
+static int same_cell(const struct cell_t *a, const struct cell_t *b)
+{
+	return !memcmp(a, b, sizeof(*a));
+}
+
+/* the shortest way from the cursor to (x, y): reprint the unchanged cells in
+ * between if they are few and have the current colors, move right on the
+ * same row, or jump
+ */
+static void move_cursor(struct render_t *r, int x, int y)
+{
+	int i, gap, cost;
+
+	if (r->cur_x == x && r->cur_y == y)
+		return;
+
+	if (r->cur_x >= 0 && r->cur_y == y && r->cur_x < x) {
+		const struct cell_t *c = &r->front[y * r->width + r->cur_x];
+
+		gap = x - r->cur_x;
+		cost = 0;
+		for (i = 0; i < gap; i++) {
+			if (c[i].fg != r->fg || c[i].bg != r->bg) {
+				cost = -1;
+				break;
+			}
+			cost += cell_len(&c[i]);
+		}
+
+		/* ESC [ gap C */
+		if (cost >= 0 && cost <= 3 + num_len(gap)) {
+			for (i = 0; i < gap; i++)
+				out_str(r, c[i].ch, cell_len(&c[i]));
+		} else
+			out_csi(r, gap, -1, 'C');
+	} else if (x == 0)
+		out_csi(r, y+1, -1, 'H');
+	else
+		out_csi(r, y+1, x+1, 'H');
+
+	r->cur_x = x;
+	r->cur_y = y;
+}
+
+static void set_colors(struct render_t *r, int fg, int bg)
+{
+	if (fg != r->fg && bg != r->bg)
+		out_csi(r, fg, bg, 'm');
+	else if (fg != r->fg)
+		out_csi(r, fg, -1, 'm');
+	else if (bg != r->bg)
+		out_csi(r, bg, -1, 'm');
+
+	r->fg = fg;
+	r->bg = bg;
+}
+
+static int write_out(struct render_t *r)
+{
+#if FOR_WINDOWS
+
+	fwrite(r->out, 1, r->out_len, stdout);
+	fflush(stdout);
+	r->sent = r->out_len;
+	return 1;
+
+#else
+
+	int n;
+
+	while (r->sent < r->out_len) {
+		n = write(r->fd, r->out + r->sent, r->out_len - r->sent);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			/* the rest goes when the fd is writable again */
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 1;
+			return 0;
+		}
+		r->sent += n;
+	}
+	return 1;
+
+#endif
+}
+
+int render_flush(struct render_t *r)
+{
+	int x, y, i;
+
+	if (render_pending(r)) {
+		if (!write_out(r))
+			return -1;
+		if (render_pending(r))
+			return 0;
+	}
+
+	r->out_len = 0;
+	r->sent = 0;
+	/* nothing was drawn since the last flush */
+	if (!r->invalid && r->dirty_top > r->dirty_bottom)
+		return 0;
+
+	if (r->invalid) {
+		out_str(r, "\x1b[0m\x1b[2J", 8);
+		fill_cells(r->front, r->width * r->height);
+		r->fg = default_font;
+		r->bg = default_back;
+		r->cur_x = -1;
+		r->invalid = 0;
+		r->dirty_top = 0;
+		r->dirty_bottom = r->height-1;
+	}
+
+	for (y = r->dirty_top; y <= r->dirty_bottom; y++) {
+		for (x = 0; x < r->width; x++) {
+			i = y * r->width + x;
+			if (same_cell(&r->back[i], &r->front[i]))
+				continue;
+
+			move_cursor(r, x, y);
+			set_colors(r, r->back[i].fg, r->back[i].bg);
+			out_str(r, r->back[i].ch, cell_len(&r->back[i]));
+			r->front[i] = r->back[i];
+
+			/* the cursor stays put in the last column */
+			r->cur_x = x+1 < r->width ? x+1 : -1;
+		}
+	}
+	r->dirty_top = r->height;
+	r->dirty_bottom = -1;
+
+	/* the front buffer went ahead of the terminal */
+	if (r->no_room) {
+		r->no_room = 0;
+		r->out_len = 0;
+		r->invalid = 1;
+		return -1;
+	}
+	if (!r->out_len)
+		return 0;
+
+	if (r->fd >= 0 && !write_out(r))
+		return -1;
+
+	r->frames++;
+	r->bytes += r->out_len;
+	return r->out_len;
+}
+
+int render_keyframe(struct render_t *r)
+{
+	int x, y, i, cur_x = r->cur_x, cur_y = r->cur_y, fg = r->fg, bg = r->bg;
+
+	r->out_len = 0;
+	out_str(r, "\x1b[0m\x1b[2J", 8);
+	r->fg = default_font;
+	r->bg = default_back;
+	r->cur_x = -1;
+
+	for (y = 0; y < r->height; y++) {
+		for (x = 0; x < r->width; x++) {
+			i = y * r->width + x;
+			if (same_cell(&r->front[i], &blank_cell))
+				continue;
+
+			move_cursor(r, x, y);
+			set_colors(r, r->front[i].fg, r->front[i].bg);
+			out_str(r, r->front[i].ch, cell_len(&r->front[i]));
+			r->cur_x = x+1 < r->width ? x+1 : -1;
+		}
+	}
+
+	/* where the next frame expects the cursor and the colors to be */
+	if (cur_x >= 0)
+		move_cursor(r, cur_x, cur_y);
+	set_colors(r, fg, bg);
+	r->cur_x = cur_x;
+	r->cur_y = cur_y;
+
+	if (r->no_room) {
+		r->no_room = 0;
+		r->out_len = 0;
+		r->sent = 0;
+		return -1;
+	}
+	/* for the caller, not for the fd */
+	r->sent = r->out_len;
+	return r->out_len;
+}
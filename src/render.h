@@ -0,0 +1,84 @@
+#ifndef SENTRY_H_RENDER
+#define SENTRY_H_RENDER
+
+/* Double-buffered terminal renderer. Drawing goes to the back buffer,
+ * render_flush() compares it with the front buffer (what the terminal shows)
+ * and sends only the changed cells in one write. The rows drawn since the
+ * last flush are the only ones compared, a flush after no drawing is no
+ * work and no write. With fd -1 nothing is written, the frame is left in
+ * out/out_len for the caller to send.
+ *
+ * A non-blocking fd never stalls the caller: what the fd does not take
+ * stays pending, and until it has gone out a flush only tries to send the
+ * rest. The drawing meanwhile stays in the back buffer, so however many
+ * frames were skipped the next one goes from what the terminal shows to
+ * the latest screen at once.
+ */
+
+enum {
+	default_attr = 0,
+	blinking = 5,
+	font_white = 37,
+	font_cyan = 34,
+	font_red = 31,
+	font_purple = 35,
+	default_font = 39,
+	back_red = 41,
+	back_green = 42,
+	back_yellow = 43,
+	back_blue = 44,
+	back_magenta = 45,
+	back_cyan = 46,
+	back_light_gray = 47,
+	default_back = 49
+};
+
+struct cell_t {
+	char ch[4];		/* UTF-8 glyph, nul padded */
+	unsigned char fg, bg;
+};
+
+struct render_t {
+	int fd;
+	int width, height;
+	struct cell_t *back;
+	struct cell_t *front;
+	int invalid;		/* the terminal contents are unknown */
+	int dirty_top, dirty_bottom;	/* rows drawn since the last flush,
+									 * none when top > bottom */
+	int cur_x, cur_y;	/* terminal cursor, cur_x is -1 if unknown */
+	int fg, bg;			/* terminal colors */
+	char *out;
+	int out_len, out_cap;
+	int sent;			/* bytes of out the fd took */
+	int no_room;		/* out could not grow, the frame is lost */
+	unsigned long frames, bytes;
+};
+
+/* coordinates are 1-based as in the terminal */
+int render_init(struct render_t *r, int fd, int width, int height);
+void render_free(struct render_t *r);
+/* a terminal of another size: the back buffer is cleared and the next flush
+ * repaints, returns 0 when out of memory (the old size is kept then)
+ */
+int render_resize(struct render_t *r, int width, int height);
+void render_clear(struct render_t *r);
+void render_text(struct render_t *r, int x, int y, const char *s,
+				 int fg, int bg);
+void render_invalidate(struct render_t *r);
+/* the bytes of the new frame, 0 if there is none yet, -1 on a write error
+ * or when out of memory (the next flush repaints then)
+ */
+int render_flush(struct render_t *r);
+/* Everything the terminal shows, drawn from a cleared screen into out, for
+ * a second terminal that is to follow the frames from now on. Ends with the
+ * cursor and the colors where the next frame expects them. Not while a
+ * frame is pending, the keyframe takes its place in out. -1 when out of
+ * memory.
+ */
+int render_keyframe(struct render_t *r);
+
+/* a frame is still going out, wait for the fd to be writable */
+#define render_pending(r) ((r)->fd >= 0 && (r)->sent < (r)->out_len)
+
+#endif
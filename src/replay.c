@@ -0,0 +1,321 @@
+#include <stdio.h>
+#include <stdlib.h> /* malloc, realloc */
+#include <string.h> /* memcmp, memcpy, memset */
+#include "engine.h"
+#include "replay.h"
+
+/* header:   "TTRP" u16 version u16 randomizer u32 seed u32 gravity
+ *           u32 state_size u16 width u16 height
+ * input:    u8 input (1..input_tick), varint ms since the previous record
+ * keyframe: u8 rec_keyframe, u32 ms, the first state_size bytes of struct
+ *           engine_t (see engine_size)
+ * end:      u8 rec_end
+ * index:    count * (u32 piece, u32 offset of the keyframe)
+ * trailer:  u32 count, u32 offset of the index, "TTRI"
+ * All numbers are little endian.
+ */
+
+enum { replay_version = 3, header_size = 24, trailer_size = 12 };
+
+enum { rec_end = 0, rec_keyframe = 0x80 };
+
+static const char header_magic[4] = "TTRP";
+static const char trailer_magic[4] = "TTRI";
+
+static void put_u16(FILE *fp, unsigned int v)
+{
+	putc(v & 0xff, fp);
+	putc((v >> 8) & 0xff, fp);
+}
+
+static void put_u32(FILE *fp, unsigned long v)
+{
+	put_u16(fp, v & 0xffff);
+	put_u16(fp, (v >> 16) & 0xffff);
+}
+
+static void put_varint(FILE *fp, unsigned long v)
+{
+	while (v >= 0x80) {
+		putc((int)(v & 0x7f) | 0x80, fp);
+		v >>= 7;
+	}
+	putc((int)v, fp);
+}
+
+static int get_u16(FILE *fp, unsigned int *v)
+{
+	int lo = getc(fp), hi = getc(fp);
+
+	if (lo == EOF || hi == EOF)
+		return 0;
+	*v = (unsigned int)lo | (unsigned int)hi << 8;
+	return 1;
+}
+
+static int get_u32(FILE *fp, unsigned long *v)
+{
+	unsigned int lo, hi;
+
+	if (!get_u16(fp, &lo) || !get_u16(fp, &hi))
+		return 0;
+	*v = (unsigned long)lo | (unsigned long)hi << 16;
+	return 1;
+}
+
+static int get_varint(FILE *fp, unsigned long *v)
+{
+	int c, shift = 0;
+
+	*v = 0;
+	do {
+		c = getc(fp);
+		if (c == EOF || shift > 28)
+			return 0;
+		*v |= (unsigned long)(c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+
+	return 1;
+}
+
+static int add_keyframe(struct replay_t *r, unsigned long piece,
+						unsigned long offset)
+{
+	if (r->count == r->cap) {
+		struct keyframe_t *p;
+
+		r->cap = r->cap ? r->cap * 2 : 64;
+		p = realloc(r->index, r->cap * sizeof(*p));
+		if (!p)
+			return 0;
+		r->index = p;
+	}
+
+	r->index[r->count].piece = piece;
+	r->index[r->count].offset = offset;
+	r->count++;
+	return 1;
+}
+
+static void write_keyframe(struct replay_t *r, const struct engine_t *e)
+{
+	if (!add_keyframe(r, e->pieces, (unsigned long)ftell(r->fp)))
+		return;
+
+	putc(rec_keyframe, r->fp);
+	put_u32(r->fp, r->last_ms);
+	fwrite(e, engine_size(e), 1, r->fp);
+}
+
+int replay_create(struct replay_t *r, const char *path, const struct engine_t *e,
+				  unsigned int seed)
+{
+	memset(r, 0, sizeof(*r));
+	r->fp = fopen(path, "wb");
+	if (!r->fp)
+		return 0;
+
+	r->writing = 1;
+	r->seed = seed;
+	r->gravity = e->gravity;
+	r->randomizer = e->randomizer;
+	r->width = e->width;
+	r->height = e->height;
+	r->state_size = engine_size(e);
+	r->state_ok = 1;
+
+	fwrite(header_magic, 4, 1, r->fp);
+	put_u16(r->fp, replay_version);
+	put_u16(r->fp, (unsigned int)e->randomizer);
+	put_u32(r->fp, seed);
+	put_u32(r->fp, (unsigned long)e->gravity);
+	put_u32(r->fp, (unsigned long)engine_size(e));
+	put_u16(r->fp, (unsigned int)e->width);
+	put_u16(r->fp, (unsigned int)e->height);
+
+	write_keyframe(r, e);
+	return 1;
+}
+
+/* e is the state after the input, a keyframe follows every replay_interval
+ * locked pieces
+ */
+void replay_input(struct replay_t *r, enum engine_input in, unsigned long ms,
+				  const struct engine_t *e)
+{
+	putc((int)in, r->fp);
+	put_varint(r->fp, ms - r->last_ms);
+	r->last_ms = ms;
+
+	if (!e->game_over && e->pieces == (unsigned long)r->count * replay_interval)
+		write_keyframe(r, e);
+}
+
+static int read_index(struct replay_t *r)
+{
+	unsigned long count, offset, piece, kf_offset, i;
+	char magic[4];
+
+	if (fseek(r->fp, -trailer_size, SEEK_END) != 0
+		|| !get_u32(r->fp, &count) || !get_u32(r->fp, &offset)
+		|| fread(magic, 4, 1, r->fp) != 1
+		|| memcmp(magic, trailer_magic, 4) != 0)
+		return 0;
+
+	if (fseek(r->fp, (long)offset, SEEK_SET) != 0)
+		return 0;
+	for (i = 0; i < count; i++) {
+		if (!get_u32(r->fp, &piece) || !get_u32(r->fp, &kf_offset)
+			|| !add_keyframe(r, piece, kf_offset))
+			return 0;
+	}
+
+	return 1;
+}
+
+int replay_open(struct replay_t *r, const char *path)
+{
+	unsigned int version, randomizer, width, height;
+	unsigned long seed, gravity, state_size;
+	char magic[4];
+
+	memset(r, 0, sizeof(*r));
+	r->fp = fopen(path, "rb");
+	if (!r->fp)
+		return 0;
+
+	if (fread(magic, 4, 1, r->fp) != 1 || memcmp(magic, header_magic, 4) != 0
+		|| !get_u16(r->fp, &version) || version != replay_version
+		|| !get_u16(r->fp, &randomizer) || randomizer >= randomizer_count
+		|| !get_u32(r->fp, &seed)
+		|| !get_u32(r->fp, &gravity) || gravity < 1
+		|| gravity > board_max_height || !get_u32(r->fp, &state_size)
+		|| !get_u16(r->fp, &width) || !get_u16(r->fp, &height)
+		|| width < board_min_width || width > board_max_width
+		|| height < board_min_height || height > board_max_height) {
+		fclose(r->fp);
+		r->fp = NULL;
+		return 0;
+	}
+
+	r->seed = (unsigned int)seed;
+	r->gravity = (int)gravity;
+	r->randomizer = (int)randomizer;
+	r->width = (int)width;
+	r->height = (int)height;
+	r->state_size = state_size;
+	/* states of other builds are skipped, seeking simulates instead */
+	r->state_ok = state_size == engine_bytes(width, height);
+
+	/* without the index (the game did not end normally) seeking has to
+	 * simulate from the start
+	 */
+	if (!read_index(r))
+		r->count = 0;
+
+	fseek(r->fp, header_size, SEEK_SET);
+	return 1;
+}
+
+int replay_next(struct replay_t *r, struct replay_record_t *rec)
+{
+	unsigned long delta;
+	int c;
+
+	for (;;) {
+		c = getc(r->fp);
+		if (c == EOF)
+			return 0;
+
+		if (c == rec_keyframe) {
+			if (!get_u32(r->fp, &r->last_ms)
+				|| fseek(r->fp, (long)r->state_size, SEEK_CUR) != 0)
+				return 0;
+			continue;
+		}
+
+		if (c < input_left || c > input_tick || !get_varint(r->fp, &delta))
+			return 0;
+
+		r->last_ms += delta;
+		rec->in = (enum engine_input)c;
+		rec->ms = r->last_ms;
+		return 1;
+	}
+}
+
+/* the keyframe at or before piece into e, 0 if it cannot be read or is
+ * not a state of this game; the file is then where it was
+ */
+static int read_keyframe(struct replay_t *r, struct engine_t *e,
+						 unsigned long piece)
+{
+	struct engine_t *t;
+	unsigned long k = piece / replay_interval, ms;
+	long pos = ftell(r->fp);
+	int ok;
+
+	if (k >= (unsigned long)r->count)
+		k = r->count - 1;
+	t = malloc(engine_alloc_size(r->width, r->height));
+	ok = t && fseek(r->fp, (long)r->index[k].offset, SEEK_SET) == 0
+		&& getc(r->fp) == rec_keyframe && get_u32(r->fp, &ms)
+		&& fread(t, r->state_size, 1, r->fp) == 1
+		&& t->width == r->width && t->height == r->height
+		&& t->randomizer == r->randomizer && t->gravity == r->gravity
+		&& t->pieces == r->index[k].piece && t->pieces <= piece
+		&& engine_valid(t);
+	if (ok) {
+		memcpy(e, t, r->state_size);
+		r->last_ms = ms;
+	} else
+		fseek(r->fp, pos, SEEK_SET);
+	free(t);
+	return ok;
+}
+
+/* e must be initialized from the replay seed, a keyframe that does not
+ * check out is passed over and the game is played from the start instead
+ */
+int replay_seek(struct replay_t *r, struct engine_t *e, unsigned long piece)
+{
+	struct replay_record_t rec;
+
+	if (r->count && r->state_ok)
+		read_keyframe(r, e, piece);
+
+	while (e->pieces < piece && !e->game_over && replay_next(r, &rec))
+		engine_step(e, rec.in);
+
+	return e->pieces >= piece;
+}
+
+int replay_close(struct replay_t *r)
+{
+	unsigned long offset;
+	int i, ok = 1;
+
+	if (!r->fp)
+		return 0;
+
+	if (r->writing) {
+		putc(rec_end, r->fp);
+		offset = (unsigned long)ftell(r->fp);
+		for (i = 0; i < r->count; i++) {
+			put_u32(r->fp, r->index[i].piece);
+			put_u32(r->fp, r->index[i].offset);
+		}
+		put_u32(r->fp, (unsigned long)r->count);
+		put_u32(r->fp, offset);
+		fwrite(trailer_magic, 4, 1, r->fp);
+		ok = !ferror(r->fp);
+	}
+
+	if (fclose(r->fp) != 0)
+		ok = 0;
+	free(r->index);
+	r->fp = NULL;
+	r->index = NULL;
+	return ok;
+}
@@ -0,0 +1,48 @@
+#ifndef SENTRY_H_REPLAY
+#define SENTRY_H_REPLAY
+
+#include <stdio.h>
+#include "engine.h"
+
+/* Replay file: a header with the seed and the board size, the inputs
+ * stamped with the game clock, a full engine state every replay_interval
+ * pieces and an index of those keyframes at the end, so seeking to a piece
+ * reads one keyframe and simulates fewer than replay_interval pieces.
+ */
+
+enum { replay_interval = 32 };
+
+struct replay_record_t {
+	enum engine_input in;
+	unsigned long ms;		/* game clock */
+};
+
+struct keyframe_t {
+	unsigned long piece;
+	unsigned long offset;
+};
+
+struct replay_t {
+	FILE *fp;
+	int writing;
+	unsigned int seed;
+	int gravity;
+	int randomizer;
+	int width, height;		/* of the board */
+	unsigned long state_size;	/* bytes of a keyframe */
+	int state_ok;			/* keyframes were written by this build */
+	unsigned long last_ms;
+	struct keyframe_t *index;
+	int count, cap;
+};
+
+int replay_create(struct replay_t *r, const char *path, const struct engine_t *e,
+				  unsigned int seed);
+void replay_input(struct replay_t *r, enum engine_input in, unsigned long ms,
+				  const struct engine_t *e);
+int replay_open(struct replay_t *r, const char *path);
+int replay_next(struct replay_t *r, struct replay_record_t *rec);
+int replay_seek(struct replay_t *r, struct engine_t *e, unsigned long piece);
+int replay_close(struct replay_t *r);
+
+#endif
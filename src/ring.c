@@ -0,0 +1,76 @@
+#include <stdlib.h> /* malloc */
+#include <string.h> /* memcpy */
+#include "ring.h"
+
+int ring_init(struct ring_t *r, unsigned long size)
+{
+	unsigned long n = 1;
+
+	while (n < size)
+		n <<= 1;
+	r->buf = malloc(n);
+	if (!r->buf)
+		return 0;
+	r->mask = n - 1;
+	r->written = r->head = r->tail = 0;
+	return 1;
+}
+
+void ring_free(struct ring_t *r)
+{
+	free(r->buf);
+	r->buf = NULL;
+}
+
+unsigned long ring_room(struct ring_t *r)
+{
+	/* the consumer is done with what is before tail */
+	unsigned long tail = r->tail;
+
+	__sync_synchronize();
+	return r->mask + 1 - (r->written - tail);
+}
+
+int ring_write(struct ring_t *r, const void *data, unsigned long len)
+{
+	unsigned long at = r->written & r->mask, first;
+
+	if (len > ring_room(r))
+		return 0;
+	first = r->mask + 1 - at;
+	if (first > len)
+		first = len;
+	memcpy(r->buf + at, data, first);
+	memcpy(r->buf, (const char *)data + first, len - first);
+	r->written += len;
+	return 1;
+}
+
+void ring_publish(struct ring_t *r)
+{
+	/* the bytes before the position that shows them */
+	__sync_synchronize();
+	r->head = r->written;
+}
+
+unsigned long ring_used(struct ring_t *r)
+{
+	unsigned long head = r->head;
+
+	__sync_synchronize();
+	return head - r->tail;
+}
+
+void ring_read(struct ring_t *r, void *data, unsigned long len)
+{
+	unsigned long at = r->tail & r->mask, first;
+
+	first = r->mask + 1 - at;
+	if (first > len)
+		first = len;
+	memcpy(data, r->buf + at, first);
+	memcpy((char *)data + first, r->buf, len - first);
+	/* the bytes are copied before the producer may reuse them */
+	__sync_synchronize();
+	r->tail += len;
+}
@@ -0,0 +1,34 @@
+#ifndef SENTRY_H_RING
+#define SENTRY_H_RING
+
+/* Lock-free ring of bytes between one producer thread and one consumer
+ * thread. The producer writes as much as it likes and then publishes it at
+ * once, the consumer sees only published bytes. The size is a power of 2,
+ * so the positions just count up and wrap by masking.
+ */
+
+struct ring_t {
+	char *buf;
+	unsigned long mask;
+	unsigned long written;	/* producer only, not published yet */
+	/* apart, so the threads do not share a cache line */
+	volatile unsigned long head __attribute__((aligned(64)));
+	volatile unsigned long tail __attribute__((aligned(64)));
+};
+
+/* size is rounded up to a power of 2, returns 0 if out of memory */
+int ring_init(struct ring_t *r, unsigned long size);
+void ring_free(struct ring_t *r);
+
+/* producer: bytes that can be written now */
+unsigned long ring_room(struct ring_t *r);
+/* producer: returns 0 and writes nothing if there is no room for all */
+int ring_write(struct ring_t *r, const void *data, unsigned long len);
+void ring_publish(struct ring_t *r);
+
+/* consumer: bytes published and not read yet */
+unsigned long ring_used(struct ring_t *r);
+/* consumer: len must not be more than ring_used() */
+void ring_read(struct ring_t *r, void *data, unsigned long len);
+
+#endif
@@ -0,0 +1,220 @@
+#include <stdint.h> /* uint64_t */
+#include "engine.h"
+#include "rows.h"
+
+#if !FOR_WINDOWS && defined(__GNUC__) \
+	&& (defined(__x86_64__) || defined(__i386__))
+#define ROWS_X86 1
+#include <immintrin.h> /* _mm_*, _mm256_* */
+#else
+#define ROWS_X86 0
+#endif
+
+const char *const row_isa_names[row_isa_count] = { "scalar", "sse2", "avx2" };
+
+int row_isa_supported(int isa)
+{
+	switch (isa) {
+	case row_isa_scalar:
+		return 1;
+#if ROWS_X86
+	case row_isa_sse2:
+		return __builtin_cpu_supports("sse2");
+	case row_isa_avx2:
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+	return 0;
+}
+
+int row_isa_best()
+{
+#if ROWS_X86
+	if (__builtin_cpu_supports("avx2"))
+		return row_isa_avx2;
+	if (__builtin_cpu_supports("sse2"))
+		return row_isa_sse2;
+#endif
+	return row_isa_scalar;
+}
+
+/* the words of the row from w on, the last one may be partly used */
+static int full_scalar(const row_t *row, int w, int width)
+{
+	for (; w < width / 32; w++)
+		if (row[w] != ~(row_t)0)
+			return 0;
+	return width % 32 == 0 || row[w] == row_mask(width % 32);
+}
+
+/* the cells set in v, by the instruction where the compiler has one */
+static int bit_count(row_t v)
+{
+#if defined(__GNUC__)
+	return __builtin_popcount(v);
+#else
+	int n = 0;
+
+	for (; v; v &= v - 1)
+		n++;
+	return n;
+#endif
+}
+
+/* the columns of words w and on: each word keeps the cells seen occupied
+ * going down, a hole is an empty cell under one of them
+ */
+static int holes_scalar(const row_t *rows, int words, int height, int w)
+{
+	row_t covered;
+	int y, holes = 0;
+
+	for (; w < words; w++) {
+		covered = 0;
+		for (y = 0; y < height; y++) {
+			holes += bit_count(covered & ~rows[y*words + w]);
+			covered |= rows[y*words + w];
+		}
+	}
+	return holes;
+}
+
+#if ROWS_X86
+
+/* groups of 4 full words from *w on, 0 at the first that is not full */
+__attribute__((target("sse2")))
+static int full_sse2(const row_t *row, int width, int *w)
+{
+	const __m128i ones = _mm_set1_epi32(-1);
+	__m128i v;
+
+	for (; *w + 4 <= width / 32; *w += 4) {
+		v = _mm_loadu_si128((const __m128i *)(row + *w));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(v, ones)) != 0xffff)
+			return 0;
+	}
+	return 1;
+}
+
+/* groups of 4 words from *w on, the popcount of each byte in SWAR steps,
+ * psadbw adds the bytes up
+ */
+__attribute__((target("sse2")))
+static int holes_sse2(const row_t *rows, int words, int height, int *w)
+{
+	const __m128i m1 = _mm_set1_epi8(0x55), m2 = _mm_set1_epi8(0x33),
+		m4 = _mm_set1_epi8(0x0f), zero = _mm_setzero_si128();
+	__m128i row, covered, x, sum = zero;
+	uint64_t lanes[2];
+	int y;
+
+	for (; *w + 4 <= words; *w += 4) {
+		covered = zero;
+		for (y = 0; y < height; y++) {
+			row = _mm_loadu_si128((const __m128i *)(rows + y*words + *w));
+			x = _mm_andnot_si128(row, covered);
+			x = _mm_sub_epi8(x, _mm_and_si128(_mm_srli_epi16(x, 1), m1));
+			x = _mm_add_epi8(_mm_and_si128(x, m2),
+							 _mm_and_si128(_mm_srli_epi16(x, 2), m2));
+			x = _mm_and_si128(_mm_add_epi8(x, _mm_srli_epi16(x, 4)), m4);
+			sum = _mm_add_epi64(sum, _mm_sad_epu8(x, zero));
+			covered = _mm_or_si128(covered, row);
+		}
+	}
+	_mm_storeu_si128((__m128i *)lanes, sum);
+	return (int)(lanes[0] + lanes[1]);
+}
+
+/* groups of 8 full words */
+__attribute__((target("avx2")))
+static int full_avx2(const row_t *row, int width, int *w)
+{
+	const __m256i ones = _mm256_set1_epi32(-1);
+	__m256i v;
+
+	for (; *w + 8 <= width / 32; *w += 8) {
+		v = _mm256_loadu_si256((const __m256i *)(row + *w));
+		if (!_mm256_testc_si256(v, ones))
+			return 0;
+	}
+	return 1;
+}
+
+/* groups of 8 words from *w on, the popcount of each nibble from a table
+ * by vpshufb
+ */
+__attribute__((target("avx2")))
+static int holes_avx2(const row_t *rows, int words, int height, int *w)
+{
+	const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+										   1, 2, 2, 3, 2, 3, 3, 4,
+										   0, 1, 1, 2, 1, 2, 2, 3,
+										   1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i low = _mm256_set1_epi8(0x0f), zero = _mm256_setzero_si256();
+	__m256i row, covered, x, n, sum = zero;
+	uint64_t lanes[4];
+	int y;
+
+	for (; *w + 8 <= words; *w += 8) {
+		covered = zero;
+		for (y = 0; y < height; y++) {
+			row = _mm256_loadu_si256((const __m256i *)(rows + y*words + *w));
+			x = _mm256_andnot_si256(row, covered);
+			n = _mm256_add_epi8(
+				_mm256_shuffle_epi8(table, _mm256_and_si256(x, low)),
+				_mm256_shuffle_epi8(table,
+					_mm256_and_si256(_mm256_srli_epi16(x, 4), low)));
+			sum = _mm256_add_epi64(sum, _mm256_sad_epu8(n, zero));
+			covered = _mm256_or_si256(covered, row);
+		}
+	}
+	_mm256_storeu_si256((__m256i *)lanes, sum);
+	return (int)(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+}
+
+#endif
+
+/* The widest kernel takes the groups of words it can, the narrower ones
+ * the rest. Rows too narrow for a group do not enter the vector code.
+ */
+int rows_full_isa(int isa, const row_t *row, int width)
+{
+	int w = 0;
+
+	switch (isa) {
+#if ROWS_X86
+	case row_isa_avx2:
+		if (width >= 8*32 && !full_avx2(row, width, &w))
+			return 0;
+		/* fall through */
+	case row_isa_sse2:
+		if (width - 32*w >= 4*32 && !full_sse2(row, width, &w))
+			return 0;
+		break;
+#endif
+	default:
+		break;
+	}
+	return full_scalar(row, w, width);
+}
+
+int rows_holes_isa(int isa, const row_t *rows, int words, int height)
+{
+	int w = 0, holes = 0;
+
+	switch (isa) {
+#if ROWS_X86
+	case row_isa_avx2:
+		if (words >= 8)
+			holes += holes_avx2(rows, words, height, &w);
+		/* fall through */
+	case row_isa_sse2:
+		if (words - w >= 4)
+			holes += holes_sse2(rows, words, height, &w);
+		break;
+#endif
+	default:
+		break;
+	}
+	return holes + holes_scalar(rows, words, height, w);
+}
@@ -0,0 +1,29 @@
+#ifndef SENTRY_H_ROWS
+#define SENTRY_H_ROWS
+
+#include "engine.h"
+
+/* Kernels over the rows of boards of any width. A row of width cells is
+ * row_words(width) words, the rows of a board follow each other. Every
+ * kernel has a scalar version and on x86 an SSE2 and an AVX2 one; the calls
+ * without an isa take the widest the CPU has, as CPUID tells at run time.
+ */
+
+enum row_isa { row_isa_scalar, row_isa_sse2, row_isa_avx2, row_isa_count };
+
+extern const char *const row_isa_names[row_isa_count];
+
+int row_isa_supported(int isa);
+/* the widest kernels this CPU runs */
+int row_isa_best();
+
+/* 1 when all width cells of the row are occupied */
+int rows_full_isa(int isa, const row_t *row, int width);
+/* empty cells with an occupied one above them in the same column */
+int rows_holes_isa(int isa, const row_t *rows, int words, int height);
+
+#define rows_full(row, width) rows_full_isa(row_isa_best(), row, width)
+#define rows_holes(rows, words, height) \
+	rows_holes_isa(row_isa_best(), rows, words, height)
+
+#endif
@@ -0,0 +1,227 @@
+#if FOR_WINDOWS
+
+#include <Windows.h> /* MoveFileExA */
+#include <stdio.h> /* remove */
+#include <errno.h> /* errno */
+
+#else
+
+#include <stdio.h> /* rename */
+#include <unistd.h> /* write, close, unlink */
+#include <fcntl.h> /* open */
+#include <errno.h> /* errno */
+#include <sys/mman.h> /* mmap, munmap */
+#include <sys/stat.h> /* fstat */
+
+#endif
+
+#include <stdlib.h> /* malloc, free */
+#include <string.h> /* memcpy, memcmp, strcpy, strcat */
+#include "engine.h"
+#include "save.h"
+
+/* the most a save can hold */
+enum { save_max_size = sizeof(struct save_header_t)
+	   + engine_bytes(board_max_width, board_max_height) };
+
+static const char save_magic[4] = "TTSG";
+
+static unsigned int checksum(const unsigned char *p, unsigned long n)
+{
+	unsigned int h = 2166136261u;
+	unsigned long i;
+
+	for (i = 0; i < n; i++) {
+		h ^= p[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/* data is the whole file, aligned for the header */
+static int load(const unsigned char *data, unsigned long len,
+				struct engine_t *e)
+{
+	const struct save_header_t *h = (const struct save_header_t *)data;
+	const unsigned char *state = data + sizeof(*h);
+	struct engine_t *t;
+	int ok;
+
+	if (len < sizeof(*h) || memcmp(h->magic, save_magic, 4) != 0
+		|| h->version != save_version
+		|| h->rows_offset != offsetof(struct engine_t, rows)
+		|| h->width < board_min_width || h->width > board_max_width
+		|| h->height < board_min_height || h->height > board_max_height
+		|| h->state_size != offsetof(struct engine_t, rows)
+		+ h->height * (row_words(h->width) * sizeof(row_t) + 1 + h->width)
+		|| len < sizeof(*h) + h->state_size
+		|| checksum(state, h->state_size) != h->checksum)
+		return -1;
+
+	/* decoded on the side: the state has to be of the size the header
+	 * gives and a game the engine can go on with
+	 */
+	t = malloc(engine_alloc_size(h->width, h->height));
+	if (!t)
+		return 0;
+	memcpy(t, state, h->state_size);
+	ok = t->width == h->width && t->height == h->height && t->gravity >= 1
+		&& engine_valid(t);
+	if (ok)
+		memcpy(e, t, h->state_size);
+	free(t);
+	return ok ? 1 : -1;
+}
+
+#if FOR_WINDOWS
+
+/* the header and the state to path.tmp, then MoveFileEx() puts it in place,
+ * so a crash leaves the old save or the new one
+ */
+int save_write(const char *path, const struct engine_t *e)
+{
+	struct save_header_t h;
+	char *tmp = malloc(strlen(path) + 5);
+	FILE *fp;
+	int ok, err;
+
+	if (!tmp) {
+		errno = ENOMEM;
+		return 0;
+	}
+	strcpy(tmp, path);
+	strcat(tmp, ".tmp");
+	fp = fopen(tmp, "wb");
+	if (!fp) {
+		free(tmp);
+		return 0;
+	}
+	memcpy(h.magic, save_magic, 4);
+	h.version = save_version;
+	h.rows_offset = offsetof(struct engine_t, rows);
+	h.width = (unsigned short)e->width;
+	h.height = (unsigned short)e->height;
+	h.state_size = engine_size(e);
+	h.checksum = checksum((const unsigned char *)e, h.state_size);
+	errno = 0;
+	ok = fwrite(&h, sizeof(h), 1, fp) == 1
+		&& fwrite(e, h.state_size, 1, fp) == 1;
+	if (fclose(fp) != 0)
+		ok = 0;
+	if (ok && !MoveFileExA(tmp, path, MOVEFILE_REPLACE_EXISTING)) {
+		errno = EACCES;
+		ok = 0;
+	}
+	if (!ok) {
+		err = errno ? errno : EIO;
+		remove(tmp);
+		errno = err;
+	}
+	free(tmp);
+	return ok;
+}
+
+int save_read(const char *path, struct engine_t *e)
+{
+	unsigned char *data = malloc(save_max_size);
+	FILE *fp = fopen(path, "rb");
+	int res;
+
+	if (!fp || !data) {
+		if (fp)
+			fclose(fp);
+		free(data);
+		return 0;
+	}
+	res = load(data, fread(data, 1, save_max_size, fp), e);
+	fclose(fp);
+	free(data);
+	return res;
+}
+
+#else
+
+/* one write of the header and the state to path.tmp, then rename() puts it
+ * in place, so a crash leaves the old save or the new one
+ */
+int save_write(const char *path, const struct engine_t *e)
+{
+	unsigned char buf[save_max_size];
+	struct save_header_t h;
+	char *tmp = malloc(strlen(path) + 5);
+	int fd, n, len, err;
+
+	if (!tmp) {
+		errno = ENOMEM;
+		return 0;
+	}
+	strcpy(tmp, path);
+	strcat(tmp, ".tmp");
+
+	memcpy(h.magic, save_magic, 4);
+	h.version = save_version;
+	h.rows_offset = offsetof(struct engine_t, rows);
+	h.width = (unsigned short)e->width;
+	h.height = (unsigned short)e->height;
+	h.state_size = engine_size(e);
+	h.checksum = checksum((const unsigned char *)e, h.state_size);
+	memcpy(buf, &h, sizeof(h));
+	memcpy(buf + sizeof(h), e, h.state_size);
+	len = sizeof(h) + h.state_size;
+
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		free(tmp);
+		return 0;
+	}
+	do
+		n = write(fd, buf, len);
+	while (n < 0 && errno == EINTR);
+	if (n != len) {
+		err = n < 0 ? errno : EIO;
+		close(fd);
+		unlink(tmp);
+		free(tmp);
+		errno = err;
+		return 0;
+	}
+	if (close(fd) != 0 || rename(tmp, path) != 0) {
+		err = errno;
+		unlink(tmp);
+		free(tmp);
+		errno = err;
+		return 0;
+	}
+	free(tmp);
+	return 1;
+}
+
+int save_read(const char *path, struct engine_t *e)
+{
+	struct stat st;
+	void *data;
+	int fd, res;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return 0;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return 0;
+	}
+	if (st.st_size < (off_t)sizeof(struct save_header_t)
+		|| st.st_size > save_max_size) {
+		close(fd);
+		return -1;
+	}
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return 0;
+	res = load(data, st.st_size, e);
+	munmap(data, st.st_size);
+	return res;
+}
+
+#endif
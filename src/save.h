@@ -0,0 +1,34 @@
+#ifndef SENTRY_H_SAVE
+#define SENTRY_H_SAVE
+
+#include "engine.h"
+
+/* Saved game: a fixed header and the first engine_size() bytes of struct
+ * engine_t, so the board, the pieces, the score and the random generator
+ * are all there. Loading maps the file and checks the header and the
+ * checksum in place, nothing is parsed or simulated. The layout is that of
+ * the build that wrote it, other builds refuse the file.
+ */
+
+enum { save_version = 1 };
+
+struct save_header_t {
+	char magic[4];					/* "TTSG" */
+	unsigned short version;			/* save_version, tells the byte order */
+	unsigned short rows_offset;		/* of struct engine_t in the writer */
+	unsigned short width, height;	/* of the board */
+	unsigned int state_size;		/* bytes after the header */
+	unsigned int checksum;			/* FNV-1a of those bytes */
+};
+
+/* replaces path with the game at once (a temporary file renamed over it),
+ * returns 0 with errno set on failure
+ */
+int save_write(const char *path, const struct engine_t *e);
+/* 1 when e is the saved game, 0 with errno set if path cannot be read, -1
+ * if it is not a saved game of this build or not a state engine_valid()
+ * takes (e is unchanged then)
+ */
+int save_read(const char *path, struct engine_t *e);
+
+#endif
@@ -0,0 +1,1060 @@
+#define _GNU_SOURCE /* accept4, pthread_setaffinity_np */
+
+#include <stdio.h>
+#include <stdlib.h> /* malloc */
+#include <string.h> /* memcpy, memcmp, memchr */
+#include <time.h> /* clock_gettime */
+#include <errno.h> /* errno */
+#include <unistd.h> /* close, unlink, sysconf */
+#include <signal.h> /* sigprocmask, sigwait */
+#include <pthread.h>
+#include <sched.h> /* cpu_set_t */
+#include <sys/socket.h> /* socket, accept4, send, sendmsg */
+#include <sys/uio.h> /* iovec */
+#include <sys/un.h> /* sockaddr_un */
+#include <sys/stat.h> /* stat */
+#include <sys/epoll.h> /* epoll_create1, epoll_ctl, epoll_wait */
+#include <sys/eventfd.h> /* eventfd */
+#include "engine.h"
+#include "render.h"
+#include "view.h"
+#include "gravity.h"
+#include "input.h"
+#include "tetris.h"
+#include "server.h"
+
+/* the wheel turns every wheel_tick ms, a deadline further away than
+ * wheel_slots ticks waits in its slot for more turns
+ */
+enum { wheel_slots = 256, wheel_tick = 10 };
+
+enum { sessions_per_loop = 256, max_loops = 256, max_events = 64,
+	   listen_backlog = 128, read_size = 256 };
+
+/* a frame this big drops the client, a slow one only gets fewer frames */
+enum { out_limit = 1 << 18 };
+
+/* a viewer that falls this far behind gets a keyframe instead */
+enum { viewer_backlog = 64, viewer_limit = 1 << 18 };
+
+/* ms the game over screen stays before the server hangs up */
+enum { game_over_delay = 2000 };
+
+enum session_state { session_free, session_hello, session_playing,
+					 session_watching, session_closing };
+
+const char server_magic[4] = "TTSV";
+const char server_watch_magic[4] = "TTSW";
+
+/* A frame encoded once for all the viewers of a game. Viewers live in the
+ * loop of their game, so the count needs no atomics.
+ */
+struct frame_buf_t {
+	int refs;
+	int len;
+	char *data;
+};
+
+struct session_t {
+	int fd;
+	enum session_state state;
+	int paused;
+	struct engine_t *game;	/* allocated while the game is on */
+	struct view_t view;
+	unsigned char in[server_hello_size];	/* the hello so far */
+	struct input_t keys;
+	int in_len;
+	char *out;			/* frames the socket did not take yet */
+	int out_len, out_cap;
+	int want_out;		/* EPOLLOUT is on */
+	struct gravity_t gravity;
+	unsigned long deadline;	/* ms of the next timer, gravity rounded up */
+	int timer_slot;		/* -1 when not in the wheel */
+	struct session_t *timer_prev, *timer_next;
+	struct session_t *free_next;
+	unsigned int game_id;	/* 0 when no viewer can join, other loops read it */
+	struct session_t *viewers;	/* of a game */
+
+	/* of a viewer: the game, the frames not sent yet and how much of the
+	 * first went out
+	 */
+	int is_viewer;
+	struct session_t *watching;	/* NULL once the game is gone */
+	struct session_t *viewer_prev, *viewer_next;
+	struct frame_buf_t *queue[viewer_backlog];
+	int queue_head, queue_count, queue_bytes, head_sent;
+	int resync;			/* missed a frame, needs a keyframe */
+};
+
+struct wheel_t {
+	struct session_t *slots[wheel_slots];
+	unsigned long tick;	/* the next tick to run */
+	int count;
+};
+
+/* a viewer accepted by one loop, on its way to the loop of its game */
+struct handoff_t {
+	int fd;
+	int width, height;
+	unsigned int game_id;
+	struct handoff_t *next;
+};
+
+struct server_loop_t {
+	pthread_t thread;
+	int id;
+	int epoll_fd;
+	struct session_t sessions[sessions_per_loop];
+	struct session_t *free;
+	struct wheel_t wheel;
+	int wake_fd;		/* eventfd, written when handoffs come */
+	pthread_mutex_t handoff_lock;
+	struct handoff_t *handoffs;
+};
+
+static const struct game_options_t *options;
+static int listen_fd = -1, stop_fd = -1;
+static unsigned int sessions_started;
+static struct server_loop_t *loops;
+static int loop_count;
+static int min_width, min_height;	/* of a player's terminal */
+
+static unsigned long now_ms()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* the wheel has ms, a step is never made before its ns deadline */
+static void set_gravity_deadline(struct session_t *s)
+{
+	s->deadline = (unsigned long)((s->gravity.deadline + 999999) / 1000000);
+}
+
+static void wheel_add(struct wheel_t *w, struct session_t *s)
+{
+	unsigned long tick = s->deadline / wheel_tick;
+
+	/* a deadline in the past fires on the next turn */
+	if (tick < w->tick)
+		tick = w->tick;
+	s->timer_slot = (int)(tick % wheel_slots);
+	s->timer_prev = NULL;
+	s->timer_next = w->slots[s->timer_slot];
+	if (s->timer_next)
+		s->timer_next->timer_prev = s;
+	w->slots[s->timer_slot] = s;
+	w->count++;
+}
+
+static void wheel_remove(struct wheel_t *w, struct session_t *s)
+{
+	if (s->timer_slot < 0)
+		return;
+	if (s->timer_prev)
+		s->timer_prev->timer_next = s->timer_next;
+	else
+		w->slots[s->timer_slot] = s->timer_next;
+	if (s->timer_next)
+		s->timer_next->timer_prev = s->timer_prev;
+	s->timer_prev = s->timer_next = NULL;
+	s->timer_slot = -1;
+	w->count--;
+}
+
+/* ms until the next slot that has sessions, -1 if there are none */
+static int wheel_timeout(const struct wheel_t *w, unsigned long now)
+{
+	unsigned long t, due;
+
+	if (!w->count)
+		return -1;
+	for (t = w->tick; t < w->tick + wheel_slots; t++)
+		if (w->slots[t % wheel_slots])
+			break;
+	due = t * wheel_tick;
+	return due > now ? (int)(due - now) : 0;
+}
+
+static struct frame_buf_t *frame_new(const char *data, int len)
+{
+	struct frame_buf_t *f = malloc(sizeof(*f) + len);
+
+	if (!f)
+		return NULL;
+	f->refs = 1;
+	f->len = len;
+	f->data = (char *)(f + 1);
+	memcpy(f->data, data, len);
+	return f;
+}
+
+static void frame_unref(struct frame_buf_t *f)
+{
+	if (f && --f->refs == 0)
+		free(f);
+}
+
+static void viewer_pop(struct session_t *v)
+{
+	struct frame_buf_t *f = v->queue[v->queue_head];
+
+	v->queue_head = (v->queue_head + 1) % viewer_backlog;
+	v->queue_count--;
+	v->queue_bytes -= f->len;
+	v->head_sent = 0;
+	frame_unref(f);
+}
+
+/* drops the frames not started, a frame half sent has to finish */
+static void viewer_drop(struct session_t *v)
+{
+	struct frame_buf_t *f;
+	int keep = v->head_sent > 0;
+
+	while (v->queue_count > keep) {
+		v->queue_count--;
+		f = v->queue[(v->queue_head + v->queue_count) % viewer_backlog];
+		v->queue_bytes -= f->len;
+		frame_unref(f);
+	}
+}
+
+static void session_close(struct server_loop_t *loop, struct session_t *s);
+
+static void detach_viewer(struct session_t *v)
+{
+	if (v->viewer_prev)
+		v->viewer_prev->viewer_next = v->viewer_next;
+	else
+		v->watching->viewers = v->viewer_next;
+	if (v->viewer_next)
+		v->viewer_next->viewer_prev = v->viewer_prev;
+	v->viewer_prev = v->viewer_next = NULL;
+	v->watching = NULL;
+}
+
+/* the viewers of a game that ends get game_over_delay to take what is
+ * queued for them
+ */
+static void close_viewers(struct server_loop_t *loop, struct session_t *s)
+{
+	struct session_t *v;
+
+	while ((v = s->viewers) != NULL) {
+		detach_viewer(v);
+		if (!v->queue_count) {
+			session_close(loop, v);
+			continue;
+		}
+		v->state = session_closing;
+		v->deadline = now_ms() + game_over_delay;
+		wheel_add(&loop->wheel, v);
+	}
+}
+
+static void session_close(struct server_loop_t *loop, struct session_t *s)
+{
+	wheel_remove(&loop->wheel, s);
+	s->game_id = 0;
+	if (s->is_viewer) {
+		if (s->watching)
+			detach_viewer(s);
+		while (s->queue_count)
+			viewer_pop(s);
+	} else if (s->state == session_playing || s->state == session_closing) {
+		close_viewers(loop, s);
+		view_free(&s->view);
+	}
+	if (s->fd >= 0)
+		close(s->fd);
+	free(s->game);
+	s->game = NULL;
+	free(s->out);
+	s->out = NULL;
+	s->state = session_free;
+	s->free_next = loop->free;
+	loop->free = s;
+}
+
+static void set_want_out(struct server_loop_t *loop, struct session_t *s,
+						 int want)
+{
+	struct epoll_event ev;
+
+	if (s->want_out == want)
+		return;
+	ev.events = EPOLLIN | (want ? EPOLLOUT : 0);
+	ev.data.ptr = s;
+	epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, s->fd, &ev);
+	s->want_out = want;
+}
+
+/* ending, all sent and not showing the game over any more */
+static int session_done(const struct session_t *s)
+{
+	if (s->is_viewer)
+		return !s->watching && !s->queue_count;
+	return s->state == session_closing && !s->out_len && s->timer_slot < 0;
+}
+
+/* one sendmsg for all the queued frames; returns 0 if the viewer has to go */
+static int viewer_send(struct server_loop_t *loop, struct session_t *v)
+{
+	struct iovec iov[viewer_backlog];
+	struct msghdr msg;
+	struct frame_buf_t *f;
+	int i, n, left;
+
+	while (v->queue_count) {
+		for (i = 0; i < v->queue_count; i++) {
+			f = v->queue[(v->queue_head + i) % viewer_backlog];
+			iov[i].iov_base = f->data + (i ? 0 : v->head_sent);
+			iov[i].iov_len = f->len - (i ? 0 : v->head_sent);
+		}
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = v->queue_count;
+		n = (int)sendmsg(v->fd, &msg, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN)
+				break;
+			return 0;
+		}
+
+		while (n > 0) {
+			left = v->queue[v->queue_head]->len - v->head_sent;
+			if (n < left) {
+				v->head_sent += n;
+				break;
+			}
+			n -= left;
+			viewer_pop(v);
+		}
+	}
+
+	set_want_out(loop, v, v->queue_count > 0);
+	return !session_done(v);
+}
+
+static int viewer_push(struct session_t *v, struct frame_buf_t *f)
+{
+	if (v->queue_count == viewer_backlog
+		|| v->queue_bytes + f->len > viewer_limit)
+		return 0;
+	f->refs++;
+	v->queue[(v->queue_head + v->queue_count) % viewer_backlog] = f;
+	v->queue_count++;
+	v->queue_bytes += f->len;
+	return 1;
+}
+
+/* the whole screen of the game as it is now */
+static struct frame_buf_t *keyframe(struct session_t *s)
+{
+	struct render_t *r = &s->view.screen;
+	int len = render_keyframe(r);
+
+	return len < 0 ? NULL : frame_new(r->out, len);
+}
+
+/* The frame in the game's out goes to every viewer as the same buffer.
+ * A viewer too far behind loses what it did not start to read and gets a
+ * keyframe, made at most once a frame, so the game never waits for it.
+ */
+static void broadcast(struct server_loop_t *loop, struct session_t *s)
+{
+	struct render_t *r = &s->view.screen;
+	struct frame_buf_t *frame, *key = NULL;
+	struct session_t *v, *next;
+
+	frame = frame_new(r->out, r->out_len);
+	for (v = s->viewers; v; v = next) {
+		next = v->viewer_next;
+		if (!frame || v->resync || !viewer_push(v, frame)) {
+			viewer_drop(v);
+			if (!key)
+				key = keyframe(s);
+			v->resync = !key || !viewer_push(v, key);
+		}
+		if (!viewer_send(loop, v))
+			session_close(loop, v);
+	}
+	frame_unref(frame);
+	frame_unref(key);
+}
+
+/* returns 0 if the session has to go */
+static int send_pending(struct server_loop_t *loop, struct session_t *s)
+{
+	int n, done = 0;
+
+	while (done < s->out_len) {
+		n = send(s->fd, s->out + done, s->out_len - done, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN)
+				break;
+			return 0;
+		}
+		done += n;
+	}
+	memmove(s->out, s->out + done, s->out_len - done);
+	s->out_len -= done;
+
+	set_want_out(loop, s, s->out_len > 0);
+	return !session_done(s);
+}
+
+/* Sends what the frame changed. While the frame before is still going out
+ * the changes wait in the back buffer, and the frames drawn meanwhile go
+ * as one once the socket has taken it, so a slow client skips to the
+ * latest screen instead of falling behind.
+ */
+static int send_frame(struct server_loop_t *loop, struct session_t *s)
+{
+	struct render_t *r = &s->view.screen;
+	int len;
+
+	if (s->out_len)
+		return !session_done(s);
+	/* out of memory drops this client only */
+	len = render_flush(r);
+	if (len <= 0)
+		return len == 0 && !session_done(s);
+
+	if (r->out_len > out_limit)
+		return 0;
+	if (r->out_len > s->out_cap) {
+		char *p = realloc(s->out, r->out_len);
+
+		if (!p)
+			return 0;
+		s->out = p;
+		s->out_cap = r->out_len;
+	}
+	memcpy(s->out, r->out, r->out_len);
+	s->out_len = r->out_len;
+	if (s->viewers)
+		broadcast(loop, s);
+	return send_pending(loop, s);
+}
+
+/* EPOLLOUT: the rest of the frame, then what was drawn while it waited */
+static int send_more(struct server_loop_t *loop, struct session_t *s)
+{
+	int alive = send_pending(loop, s);
+
+	return s->out_len ? alive : send_frame(loop, s);
+}
+
+static void send_text(struct session_t *s, const char *text)
+{
+	send(s->fd, text, strlen(text), MSG_NOSIGNAL);
+}
+
+/* the session closes once its last frame is out; after a game over the
+ * logo stays for game_over_delay first
+ */
+static void end_session(struct server_loop_t *loop, struct session_t *s,
+						int game_over)
+{
+	wheel_remove(&loop->wheel, s);
+	s->state = session_closing;
+	s->game_id = 0;
+	if (game_over) {
+		view_game_over(&s->view);
+		s->deadline = now_ms() + game_over_delay;
+		wheel_add(&loop->wheel, s);
+	}
+}
+
+static void set_paused(struct server_loop_t *loop, struct session_t *s,
+					   int paused)
+{
+	if (s->paused == paused)
+		return;
+	s->paused = paused;
+	view_pause(&s->view, paused);
+	if (paused) {
+		gravity_pause(&s->gravity, gravity_now());
+		wheel_remove(&loop->wheel, s);
+	} else {
+		gravity_resume(&s->gravity, gravity_now());
+		set_gravity_deadline(s);
+		wheel_add(&loop->wheel, s);
+	}
+}
+
+/* the loop with game id, the newest game if id is 0 */
+static struct server_loop_t *find_game(unsigned int *id)
+{
+	struct server_loop_t *found = NULL;
+	unsigned int g, newest = 0;
+	int i, j;
+
+	for (i = 0; i < loop_count; i++) {
+		for (j = 0; j < sessions_per_loop; j++) {
+			g = __sync_fetch_and_add(&loops[i].sessions[j].game_id, 0);
+			if (!g || (*id ? g != *id : g <= newest))
+				continue;
+			newest = g;
+			found = &loops[i];
+		}
+	}
+	if (found)
+		*id = newest;
+	return found;
+}
+
+/* v is a new session of the loop, the game has to be checked again as
+ * it may have ended on the way here
+ */
+static void attach_viewer(struct server_loop_t *loop, struct session_t *v,
+						  unsigned int id, int width, int height)
+{
+	struct session_t *s;
+	struct frame_buf_t *key;
+	int i;
+
+	for (i = 0; i < sessions_per_loop; i++)
+		if (id && loop->sessions[i].game_id == id)
+			break;
+	if (i == sessions_per_loop) {
+		send_text(v, "server: no such game\r\n");
+		session_close(loop, v);
+		return;
+	}
+	s = &loop->sessions[i];
+	if (width < s->view.screen.width || height < s->view.screen.height) {
+		send_text(v, "server: the window is smaller than the player's\r\n");
+		session_close(loop, v);
+		return;
+	}
+
+	v->state = session_watching;
+	v->is_viewer = 1;
+	v->watching = s;
+	v->viewer_prev = NULL;
+	v->viewer_next = s->viewers;
+	if (s->viewers)
+		s->viewers->viewer_prev = v;
+	s->viewers = v;
+
+	key = keyframe(s);
+	v->resync = !key || !viewer_push(v, key);
+	frame_unref(key);
+	if (!viewer_send(loop, v))
+		session_close(loop, v);
+}
+
+/* hands a viewer over to the loop of its game, which owns all its viewers */
+static void pass_viewer(struct server_loop_t *loop, struct session_t *v,
+						int width, int height)
+{
+	unsigned int id = v->in[8] | v->in[9] << 8 | v->in[10] << 16
+		| (unsigned int)v->in[11] << 24;
+	struct server_loop_t *to = find_game(&id);
+	struct handoff_t *h;
+	uint64_t one = 1;
+
+	if (!to) {
+		send_text(v, "server: no such game\r\n");
+		session_close(loop, v);
+		return;
+	}
+	if (to == loop) {
+		attach_viewer(loop, v, id, width, height);
+		return;
+	}
+
+	h = malloc(sizeof(*h));
+	if (!h) {
+		session_close(loop, v);
+		return;
+	}
+	h->fd = v->fd;
+	h->width = width;
+	h->height = height;
+	h->game_id = id;
+
+	/* out of this loop before the other one can see the fd, or an event
+	 * here could still reach a session the fd no longer belongs to
+	 */
+	epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, v->fd, NULL);
+	v->fd = -1;
+	session_close(loop, v);
+
+	pthread_mutex_lock(&to->handoff_lock);
+	h->next = to->handoffs;
+	to->handoffs = h;
+	pthread_mutex_unlock(&to->handoff_lock);
+	if (write(to->wake_fd, &one, sizeof(one)) != sizeof(one))
+		perror("pass_viewer: eventfd");
+}
+
+static void start_session(struct server_loop_t *loop, struct session_t *s)
+{
+	int width = s->in[4] | s->in[5] << 8, height = s->in[6] | s->in[7] << 8;
+	unsigned int seed, n;
+
+	if (memcmp(s->in, server_watch_magic, 4) == 0) {
+		pass_viewer(loop, s, width, height);
+		return;
+	}
+	if (memcmp(s->in, server_magic, 4) != 0) {
+		session_close(loop, s);
+		return;
+	}
+	if (width < min_width || height < min_height) {
+		char buf[80];
+
+		sprintf(buf, "server: increase the window size. "
+				"Minimum screen size %dx%d\r\n", min_width, min_height);
+		send_text(s, buf);
+		session_close(loop, s);
+		return;
+	}
+
+	/* every session gets its own pieces, the same ones with --seed */
+	n = __sync_fetch_and_add(&sessions_started, 1);
+	seed = options->has_seed ? options->seed + n
+		: (unsigned int)time(NULL) ^ (n * 2654435761u);
+	s->game = malloc(engine_alloc_size(options->width, options->height));
+	if (!s->game) {
+		session_close(loop, s);
+		return;
+	}
+	engine_init_size(s->game, seed, (enum randomizer_t)options->randomizer,
+					 options->width, options->height);
+	s->game->gravity = options->gravity;
+	if (!view_init(&s->view, s->game, -1, width, height)) {
+		session_close(loop, s);
+		return;
+	}
+
+	s->state = session_playing;
+	s->in_len = 0;
+	input_init(&s->keys);
+	s->paused = 0;
+	gravity_start(&s->gravity, options->curve, s->game, gravity_now());
+	set_gravity_deadline(s);
+	wheel_add(&loop->wheel, s);
+	/* viewers can join from now on, games are numbered from 1 */
+	__sync_lock_test_and_set(&s->game_id, n+1);
+	fprintf(stderr, "server: game %u started\n", n+1);
+}
+
+/* the keys as the terminal client reads them */
+static void handle_keys(struct server_loop_t *loop, struct session_t *s,
+						const unsigned char *buf, int len)
+{
+	int key, n, res;
+	enum engine_input in;
+
+	while (len > 0 && s->state == session_playing) {
+		n = len < input_room(&s->keys) ? len : input_room(&s->keys);
+		input_feed(&s->keys, buf, n);
+		buf += n;
+		len -= n;
+		/* a client sends a sequence in one write, so a lone ESC at the
+		 * end is the Esc key
+		 */
+		if (!len && s->keys.state == input_esc)
+			input_timeout(&s->keys);
+
+		while (s->state == session_playing
+			   && (key = input_next(&s->keys)) >= 0) {
+			in = input_none;
+			switch (key) {
+			case 's':
+			case 'S':
+			case key_down:
+				in = input_down;
+				break;
+			case 'd':
+			case 'D':
+			case key_right:
+				in = input_right;
+				break;
+			case 'a':
+			case 'A':
+			case key_left:
+				in = input_left;
+				break;
+			case 'w':
+			case 'W':
+				in = input_drop;
+				break;
+			case 'r':
+			case 'R':
+			case key_up:
+				in = input_rotate;
+				break;
+			case key_space:
+				set_paused(loop, s, !s->paused);
+				break;
+			case key_esc:
+			case 'q':
+			case 'Q':
+				end_session(loop, s, 0);
+				break;
+			}
+
+			if (in == input_none || s->paused)
+				continue;
+			res = view_input(&s->view, in);
+			if (res & step_game_over)
+				end_session(loop, s, 1);
+		}
+	}
+}
+
+static void session_readable(struct server_loop_t *loop, struct session_t *s)
+{
+	unsigned char buf[read_size], *p = buf;
+	int n, used;
+
+	n = (int)read(s->fd, p, read_size);
+	if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+		session_close(loop, s);
+		return;
+	}
+	if (n < 0)
+		return;
+
+	if (s->state == session_hello) {
+		used = server_hello_size - s->in_len;
+		if (used > n)
+			used = n;
+		memcpy(s->in + s->in_len, p, used);
+		s->in_len += used;
+		if (s->in_len < server_hello_size)
+			return;
+		start_session(loop, s);
+		if (s->state != session_playing)
+			return;
+		handle_keys(loop, s, p + used, n - used);
+	} else if (s->state == session_watching) {
+		/* a viewer can only leave */
+		if (memchr(p, 'q', n) || memchr(p, 'Q', n))
+			session_close(loop, s);
+		return;
+	} else if (s->state == session_playing)
+		handle_keys(loop, s, p, n);
+	else
+		return;
+
+	if (!send_frame(loop, s))
+		session_close(loop, s);
+}
+
+static void run_timers(struct server_loop_t *loop, unsigned long now)
+{
+	struct wheel_t *w = &loop->wheel;
+	struct session_t *s, *next;
+	unsigned long last = now / wheel_tick;
+	uint64_t ns = 0;	/* now, read when a game is due */
+	int res;
+
+	/* after a long sleep every slot is due, one turn is enough */
+	if (last >= w->tick + wheel_slots)
+		w->tick = last - wheel_slots + 1;
+
+	for (; w->tick <= last; w->tick++) {
+		for (s = w->slots[w->tick % wheel_slots]; s; s = next) {
+			next = s->timer_next;
+			if (s->deadline > now)
+				continue;
+
+			wheel_remove(w, s);
+			if (s->state == session_closing) {
+				session_close(loop, s);
+				continue;
+			}
+			res = 0;
+			if (!ns)
+				ns = gravity_now();
+			while (gravity_due(&s->gravity, ns)
+				   && !(res & step_game_over)) {
+				res = view_input(&s->view, input_tick);
+				gravity_next(&s->gravity, s->game);
+			}
+			set_gravity_deadline(s);
+			if (res & step_game_over)
+				end_session(loop, s, 1);
+			else
+				wheel_add(w, s);
+
+			if (!send_frame(loop, s))
+				session_close(loop, s);
+		}
+	}
+}
+
+/* a session of the pool for the fd, NULL and the fd closed if it fails */
+static struct session_t *new_session(struct server_loop_t *loop, int fd)
+{
+	struct epoll_event ev;
+	struct session_t *s = loop->free;
+
+	loop->free = s->free_next;
+	s->fd = fd;
+	s->state = session_hello;
+	s->in_len = 0;
+	s->out = NULL;
+	s->out_len = s->out_cap = 0;
+	s->want_out = 0;
+	s->paused = 0;
+	s->timer_slot = -1;
+	s->game_id = 0;
+	s->viewers = NULL;
+	s->is_viewer = 0;
+	s->watching = NULL;
+	s->queue_head = s->queue_count = s->queue_bytes = s->head_sent = 0;
+	s->resync = 0;
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = s;
+	if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+		close(fd);
+		s->state = session_free;
+		s->free_next = loop->free;
+		loop->free = s;
+		return NULL;
+	}
+	return s;
+}
+
+static void accept_clients(struct server_loop_t *loop)
+{
+	int fd;
+
+	for (;;) {
+		fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0)
+			return;
+
+		if (!loop->free) {
+			send(fd, "server: full\r\n", 14, MSG_NOSIGNAL);
+			close(fd);
+			continue;
+		}
+		new_session(loop, fd);
+	}
+}
+
+static void take_viewers(struct server_loop_t *loop)
+{
+	struct handoff_t *h, *next;
+	struct session_t *s;
+	uint64_t count;
+
+	if (read(loop->wake_fd, &count, sizeof(count)) != sizeof(count))
+		return;
+	pthread_mutex_lock(&loop->handoff_lock);
+	h = loop->handoffs;
+	loop->handoffs = NULL;
+	pthread_mutex_unlock(&loop->handoff_lock);
+
+	for (; h; h = next) {
+		next = h->next;
+		if (!loop->free) {
+			send(h->fd, "server: full\r\n", 14, MSG_NOSIGNAL);
+			close(h->fd);
+		} else if ((s = new_session(loop, h->fd)) != NULL)
+			attach_viewer(loop, s, h->game_id, h->width, h->height);
+		free(h);
+	}
+}
+
+static void *run_loop(void *arg)
+{
+	struct server_loop_t *loop = arg;
+	struct epoll_event events[max_events];
+	struct session_t *s;
+	int i, n;
+
+	loop->wheel.tick = now_ms() / wheel_tick;
+	for (;;) {
+		n = epoll_wait(loop->epoll_fd, events, max_events,
+					   wheel_timeout(&loop->wheel, now_ms()));
+		if (n < 0 && errno != EINTR)
+			break;
+
+		for (i = 0; i < n; i++) {
+			s = events[i].data.ptr;
+			if (s == NULL) {
+				accept_clients(loop);
+				continue;
+			}
+			if (s == (struct session_t *)loop)
+				return NULL;
+			if (s == (struct session_t *)&loop->wake_fd) {
+				take_viewers(loop);
+				continue;
+			}
+			if (s->state == session_free)
+				continue;
+			if (events[i].events & EPOLLOUT
+				&& !(s->is_viewer ? viewer_send(loop, s)
+					 : send_more(loop, s))) {
+				session_close(loop, s);
+				continue;
+			}
+			if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+				session_readable(loop, s);
+		}
+
+		run_timers(loop, now_ms());
+	}
+
+	return NULL;
+}
+
+static int init_loop(struct server_loop_t *loop, int id)
+{
+	struct epoll_event ev;
+	int i;
+
+	loop->id = id;
+	memset(&loop->wheel, 0, sizeof(loop->wheel));
+	loop->free = NULL;
+	loop->handoffs = NULL;
+	pthread_mutex_init(&loop->handoff_lock, NULL);
+	for (i = sessions_per_loop-1; i >= 0; i--) {
+		loop->sessions[i].state = session_free;
+		loop->sessions[i].game = NULL;
+		loop->sessions[i].out = NULL;
+		loop->sessions[i].timer_slot = -1;
+		loop->sessions[i].game_id = 0;
+		loop->sessions[i].free_next = loop->free;
+		loop->free = &loop->sessions[i];
+	}
+
+	loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	loop->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (loop->epoll_fd < 0 || loop->wake_fd < 0)
+		return 0;
+
+	/* one waiting loop is woken per new client */
+	ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+	ev.data.ptr = NULL;
+	if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) != 0)
+		return 0;
+	ev.events = EPOLLIN;
+	ev.data.ptr = &loop->wake_fd;
+	if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->wake_fd, &ev) != 0)
+		return 0;
+	ev.events = EPOLLIN;
+	ev.data.ptr = loop;
+	return epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, stop_fd, &ev) == 0;
+}
+
+static int open_socket(const char *path)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "run_server: socket path too long\n");
+		return 0;
+	}
+	/* a socket left over by a server that did not exit */
+	if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(path);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (listen_fd < 0
+		|| bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0
+		|| listen(listen_fd, listen_backlog) != 0) {
+		perror(path);
+		return 0;
+	}
+	return 1;
+}
+
+int run_server(const char *path, const struct game_options_t *opts)
+{
+	sigset_t mask;
+	cpu_set_t cpus;
+	int i, count, sig;
+	uint64_t one = 1;
+
+	options = opts;
+	view_min_size(opts->width, opts->height, &min_width, &min_height);
+	count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (count < 1)
+		count = 1;
+	if (count > max_loops)
+		count = max_loops;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGHUP);
+	/* the loops inherit the mask, signals only come to sigwait() */
+	pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+	if (!open_socket(path))
+		return 1;
+	stop_fd = eventfd(0, EFD_CLOEXEC);
+	loops = malloc(count * sizeof(*loops));
+	if (stop_fd < 0 || !loops) {
+		fprintf(stderr, "run_server: out of memory\n");
+		return 1;
+	}
+
+	loop_count = count;
+	for (i = 0; i < count; i++) {
+		if (!init_loop(&loops[i], i)
+			|| pthread_create(&loops[i].thread, NULL, run_loop,
+							  &loops[i]) != 0) {
+			fprintf(stderr, "run_server: cannot start loop %d\n", i);
+			return 1;
+		}
+		CPU_ZERO(&cpus);
+		CPU_SET(i, &cpus);
+		pthread_setaffinity_np(loops[i].thread, sizeof(cpus), &cpus);
+	}
+	fprintf(stderr, "server: %d loops, %d sessions each, on %s\n", count,
+			sessions_per_loop, path);
+
+	sigwait(&mask, &sig);
+
+	if (write(stop_fd, &one, sizeof(one)) != sizeof(one))
+		perror("run_server: eventfd");
+	for (i = 0; i < count; i++)
+		pthread_join(loops[i].thread, NULL);
+	for (i = 0; i < count; i++) {
+		struct handoff_t *h, *next;
+		int j;
+
+		for (j = 0; j < sessions_per_loop; j++)
+			if (loops[i].sessions[j].state != session_free)
+				session_close(&loops[i], &loops[i].sessions[j]);
+		for (h = loops[i].handoffs; h; h = next) {
+			next = h->next;
+			close(h->fd);
+			free(h);
+		}
+		close(loops[i].epoll_fd);
+		close(loops[i].wake_fd);
+		pthread_mutex_destroy(&loops[i].handoff_lock);
+	}
+
+	close(listen_fd);
+	close(stop_fd);
+	unlink(path);
+	free(loops);
+	return 0;
+}
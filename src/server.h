@@ -0,0 +1,28 @@
+#ifndef SENTRY_H_SERVER
+#define SENTRY_H_SERVER
+
+#include "tetris.h"
+
+/* Game server. Every client of the Unix socket plays its own game in this
+ * process: one epoll loop per core owns a pool of sessions and a timer
+ * wheel of their gravity deadlines, and sends each session only what its
+ * frames changed. Games are numbered from 1 as they start; a viewer gets a
+ * keyframe of the game and then the same frames as its player, encoded
+ * once for all the viewers.
+ *
+ * client to server: "TTSV" to play or "TTSW" to watch, u16 width,
+ *                   u16 height, u32 game to watch, 0 for the newest
+ *                   (little endian), then the bytes of the keys as the
+ *                   terminal sends them
+ * server to client: terminal output, the server hangs up when the game ends
+ */
+
+enum { server_hello_size = 12 };
+
+extern const char server_magic[4];
+extern const char server_watch_magic[4];
+
+/* runs until SIGINT, SIGTERM or SIGHUP, returns the exit code */
+int run_server(const char *path, const struct game_options_t *opts);
+
+#endif
@@ -0,0 +1,396 @@
+#include <stdio.h>
+#include <stdlib.h> /* strtoul, posix_memalign */
+#include <string.h> /* strcmp */
+#include <time.h> /* clock_gettime */
+#include <unistd.h> /* sysconf */
+#include <pthread.h>
+#include "engine.h"
+#include "bot.h"
+
+/* Batch simulation: plays games for a range of seeds on all cores with a
+ * built-in policy and streams one CSV row per game to stdout. Every worker
+ * owns a range of seeds and its games, the only shared state is the range
+ * bounds: a worker out of seeds steals half of the rest of another range.
+ */
+
+enum { default_games = 1000, default_max_pieces = 10000 };
+
+enum { out_size = 65536, out_line = 128, queue_size = bot_max_moves };
+
+enum policy_t { policy_random, policy_greedy, policy_beam, policy_count };
+
+static const char *const policy_names[policy_count] = {
+	"random", "greedy", "beam"
+};
+
+struct sim_options_t {
+	unsigned long games;
+	unsigned long first_seed;
+	unsigned long max_pieces;	/* 0 plays until game over */
+	int threads;
+	int policy;
+	int randomizer;
+	int gravity;
+	int beam;
+};
+
+/* what the policy knows about the game it plays */
+struct player_t {
+	unsigned int rng;
+	unsigned long planned;		/* pieces when the queue was filled */
+	struct bot_t *bot;
+	enum engine_input queue[queue_size];
+	int len, pos;
+};
+
+struct totals_t {
+	unsigned long games, pieces, lines, inputs;
+	double score;
+};
+
+/* aligned so that the bounds of two workers never share a cache line */
+struct worker_t {
+	pthread_mutex_t lock;
+	unsigned long next, end;	/* seeds still to play */
+	pthread_t thread;
+	int id;
+	struct totals_t totals;
+	struct bot_t bot;
+	size_t out_len;
+	char out[out_size];
+} __attribute__((aligned(64)));
+
+static struct sim_options_t options;
+static struct worker_t *workers;
+
+/* xorshift32, only for the moves of the random policy */
+static unsigned int player_random(struct player_t *p)
+{
+	p->rng ^= p->rng << 13;
+	p->rng ^= p->rng >> 17;
+	p->rng ^= p->rng << 5;
+	return p->rng;
+}
+
+static enum engine_input play_random(struct player_t *p)
+{
+	static const enum engine_input moves[] = {
+		input_left, input_right, input_rotate, input_down, input_tick,
+		input_drop
+	};
+
+	return moves[player_random(p) % (sizeof(moves) / sizeof(moves[0]))];
+}
+
+/* Tries every rotation and column of the current piece on a copy of the
+ * game and queues the inputs of the best placement, scored as the bot
+ * scores its first level.
+ */
+static void plan_greedy(struct player_t *p, const struct engine_t *e)
+{
+	struct engine_t t;
+	int rot, x, i, res, found = 0, best_rot = 0, best_x = e->curr.x;
+	double score, best = 0;
+
+	for (rot = 0; rot < 4; rot++) {
+		for (x = -3; x < board_width; x++) {
+			engine_copy(&t, e);
+			for (i = 0; i < rot && engine_step(&t, input_rotate); i++)
+				;
+			if (i < rot)
+				break;
+			while (t.curr.x > x && engine_step(&t, input_left))
+				;
+			while (t.curr.x < x && engine_step(&t, input_right))
+				;
+			if (t.curr.x != x)
+				continue;
+			res = engine_step(&t, input_drop);
+			score = res & step_game_over ? -1e9
+				: bot_evaluate(&bot_default_weights, &t, t.lines);
+			if (!found || score > best) {
+				found = 1;
+				best = score;
+				best_rot = rot;
+				best_x = x;
+			}
+		}
+	}
+
+	p->len = p->pos = 0;
+	for (i = 0; i < best_rot; i++)
+		p->queue[p->len++] = input_rotate;
+	for (x = e->curr.x; x > best_x; x--)
+		p->queue[p->len++] = input_left;
+	for (x = e->curr.x; x < best_x; x++)
+		p->queue[p->len++] = input_right;
+	p->queue[p->len++] = input_drop;
+	p->planned = e->pieces;
+}
+
+static enum engine_input play_greedy(struct player_t *p,
+									 const struct engine_t *e)
+{
+	if (p->pos == p->len || p->planned != e->pieces)
+		plan_greedy(p, e);
+	return p->queue[p->pos++];
+}
+
+/* the bot searches on the worker's thread, the games are the parallelism */
+static enum engine_input play_beam(struct player_t *p, const struct engine_t *e)
+{
+	if (p->pos == p->len || p->planned != e->pieces) {
+		p->len = bot_plan(p->bot, e, p->queue);
+		p->pos = 0;
+		p->planned = e->pieces;
+		if (!p->len)
+			p->queue[p->len++] = input_drop;
+	}
+	return p->queue[p->pos++];
+}
+
+static void flush_output(struct worker_t *w)
+{
+	/* one fwrite is one locked append, rows of workers never interleave */
+	fwrite(w->out, 1, w->out_len, stdout);
+	w->out_len = 0;
+}
+
+static void play_game(struct worker_t *w, unsigned long seed)
+{
+	struct engine_t e;
+	struct player_t p;
+	unsigned long lines = 0, inputs = 0;
+	int res;
+
+	engine_init(&e, (unsigned int)seed, (enum randomizer_t)options.randomizer);
+	e.gravity = options.gravity;
+	p.rng = (unsigned int)seed * 2654435761u | 1;
+	p.len = p.pos = 0;
+	p.planned = 0;
+	p.bot = &w->bot;
+
+	while (!e.game_over
+		   && (!options.max_pieces || e.pieces < options.max_pieces)) {
+		switch (options.policy) {
+		case policy_greedy:
+			res = engine_step(&e, play_greedy(&p, &e));
+			break;
+		case policy_beam:
+			res = engine_step(&e, play_beam(&p, &e));
+			break;
+		default:
+			res = engine_step(&e, play_random(&p));
+		}
+		inputs++;
+		if (res & step_lines)
+			lines += e.lines;
+	}
+
+	w->totals.games++;
+	w->totals.pieces += e.pieces;
+	w->totals.lines += lines;
+	w->totals.inputs += inputs;
+	w->totals.score += e.score;
+
+	if (w->out_len + out_line > out_size)
+		flush_output(w);
+	w->out_len += sprintf(w->out + w->out_len, "%lu,%lu,%lu,%d,%lu,%d\n",
+						  seed, e.pieces, lines, e.score, inputs, e.game_over);
+}
+
+/* The own range is taken from the front, a thief takes the back half of
+ * the first other range that has seeds left. A worker never holds two
+ * locks at once.
+ */
+static int take_seed(struct worker_t *w, unsigned long *seed)
+{
+	unsigned long lo = 0, hi = 0;
+	int i, found = 0;
+
+	pthread_mutex_lock(&w->lock);
+	if (w->next < w->end) {
+		*seed = w->next++;
+		found = 1;
+	}
+	pthread_mutex_unlock(&w->lock);
+	if (found)
+		return 1;
+
+	for (i = 1; i < options.threads && !found; i++) {
+		struct worker_t *v = &workers[(w->id + i) % options.threads];
+
+		pthread_mutex_lock(&v->lock);
+		if (v->next < v->end) {
+			hi = v->end;
+			lo = v->end - (v->end - v->next + 1) / 2;
+			v->end = lo;
+			found = 1;
+		}
+		pthread_mutex_unlock(&v->lock);
+	}
+	if (!found)
+		return 0;
+
+	pthread_mutex_lock(&w->lock);
+	*seed = lo;
+	w->next = lo+1;
+	w->end = hi;
+	pthread_mutex_unlock(&w->lock);
+	return 1;
+}
+
+static void *run_worker(void *arg)
+{
+	struct worker_t *w = arg;
+	unsigned long seed;
+
+	while (take_seed(w, &seed))
+		play_game(w, seed);
+	flush_output(w);
+	return NULL;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [--games n] [--seed n] [--threads n] "
+			"[--policy random|greedy|beam]\n"
+			"       [--beam n] [--randomizer uniform|bag|history] "
+			"[--gravity rows] [--max-pieces n]\n", name);
+}
+
+static int find_name(const char *const *names, int count, const char *s)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		if (!strcmp(s, names[i]))
+			return i;
+	return -1;
+}
+
+static int parse_args(int argc, char **argv, struct sim_options_t *opts)
+{
+	int i;
+
+	opts->games = default_games;
+	opts->first_seed = 1;
+	opts->max_pieces = default_max_pieces;
+	opts->threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	opts->policy = policy_greedy;
+	opts->randomizer = randomizer_uniform;
+	opts->gravity = 1;
+	opts->beam = bot_default_beam;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--games") && i+1 < argc) {
+			opts->games = strtoul(argv[++i], NULL, 10);
+		} else if (!strcmp(argv[i], "--seed") && i+1 < argc) {
+			opts->first_seed = strtoul(argv[++i], NULL, 10);
+		} else if (!strcmp(argv[i], "--threads") && i+1 < argc) {
+			opts->threads = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--max-pieces") && i+1 < argc) {
+			opts->max_pieces = strtoul(argv[++i], NULL, 10);
+		} else if (!strcmp(argv[i], "--gravity") && i+1 < argc) {
+			opts->gravity = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--beam") && i+1 < argc) {
+			opts->beam = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--policy") && i+1 < argc) {
+			opts->policy = find_name(policy_names, policy_count, argv[++i]);
+		} else if (!strcmp(argv[i], "--randomizer") && i+1 < argc) {
+			opts->randomizer = find_name(randomizer_names, randomizer_count,
+										 argv[++i]);
+		} else {
+			usage(argv[0]);
+			return 0;
+		}
+	}
+
+	if (opts->threads < 1 || opts->gravity < 1 || opts->policy < 0
+		|| opts->randomizer < 0) {
+		usage(argv[0]);
+		return 0;
+	}
+
+	return 1;
+}
+
+static double now_sec()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+	struct totals_t sum;
+	unsigned long share;
+	int i;
+	double t;
+
+	if (!parse_args(argc, argv, &options))
+		return 1;
+
+	if (posix_memalign((void **)&workers, 64,
+					   options.threads * sizeof(*workers)) != 0) {
+		fprintf(stderr, "main: out of memory\n");
+		return 1;
+	}
+
+	printf("seed,pieces,lines,score,inputs,game_over\n");
+	fflush(stdout);
+
+	t = now_sec();
+	share = options.games / options.threads;
+	for (i = 0; i < options.threads; i++) {
+		struct worker_t *w = &workers[i];
+
+		pthread_mutex_init(&w->lock, NULL);
+		w->id = i;
+		w->next = options.first_seed + i * share;
+		w->end = i == options.threads-1 ? options.first_seed + options.games
+			: w->next + share;
+		memset(&w->totals, 0, sizeof(w->totals));
+		w->out_len = 0;
+		if (!bot_init(&w->bot, 1, options.beam)) {
+			fprintf(stderr, "main: out of memory\n");
+			return 1;
+		}
+	}
+	for (i = 0; i < options.threads; i++) {
+		if (pthread_create(&workers[i].thread, NULL, run_worker,
+						   &workers[i]) != 0) {
+			fprintf(stderr, "main: cannot start worker %d\n", i);
+			return 1;
+		}
+	}
+
+	memset(&sum, 0, sizeof(sum));
+	for (i = 0; i < options.threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		sum.games += workers[i].totals.games;
+		sum.pieces += workers[i].totals.pieces;
+		sum.lines += workers[i].totals.lines;
+		sum.inputs += workers[i].totals.inputs;
+		sum.score += workers[i].totals.score;
+		pthread_mutex_destroy(&workers[i].lock);
+		bot_free(&workers[i].bot);
+	}
+	t = now_sec() - t;
+	fflush(stdout);
+
+	fprintf(stderr, "%lu games, %d threads, %s policy: %.3f s, %.1f games/s, "
+			"%.0f pieces/s\n", sum.games, options.threads,
+			policy_names[options.policy], t, t > 0 ? sum.games / t : 0.0,
+			t > 0 ? sum.pieces / t : 0.0);
+	if (sum.games)
+		fprintf(stderr, "mean: %.1f pieces, %.1f lines, %.1f score, "
+				"%.1f inputs\n", (double)sum.pieces / sum.games,
+				(double)sum.lines / sum.games, sum.score / sum.games,
+				(double)sum.inputs / sum.games);
+
+	free(workers);
+	return 0;
+}
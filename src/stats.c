@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <time.h> /* clock_gettime */
+#include "stats.h"
+
+enum { bucket_count = 65 };
+
+/* bucket b counts the values that need b bits: 0 in bucket 0, 1 in 1,
+ * 2..3 in 2, 4..7 in 3 and so on
+ */
+struct histogram_t {
+	unsigned long count;
+	uint64_t sum, max;
+	unsigned long buckets[bucket_count];
+	uint64_t started;		/* ns, 0 when not running */
+	uint64_t last_total;
+};
+
+static struct histogram_t histograms[stats_count];
+
+static const char *const histogram_names[stats_count] = {
+	"read_ns", "logic_ns", "flush_ns", "tick_ns", "latency_ns", "bytes"
+};
+
+static uint64_t now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void stats_record(enum stats_histogram h, uint64_t value)
+{
+	struct histogram_t *s = &histograms[h];
+
+	s->count++;
+	s->sum += value;
+	if (value > s->max)
+		s->max = value;
+	s->buckets[value ? 64 - __builtin_clzll(value) : 0]++;
+}
+
+void stats_record_total(enum stats_histogram h, uint64_t total)
+{
+	stats_record(h, total - histograms[h].last_total);
+	histograms[h].last_total = total;
+}
+
+void stats_start_clock(enum stats_histogram h)
+{
+	histograms[h].started = now_ns();
+}
+
+void stats_stop_clock(enum stats_histogram h)
+{
+	struct histogram_t *s = &histograms[h];
+
+	if (!s->started)
+		return;
+	stats_record(h, now_ns() - s->started);
+	s->started = 0;
+}
+
+/* the largest value the bucket with the p-th percentile can hold */
+static uint64_t percentile(const struct histogram_t *s, int p)
+{
+	unsigned long rank = (s->count * p + 99) / 100, seen = 0;
+	int b;
+
+	for (b = 0; b < bucket_count; b++) {
+		seen += s->buckets[b];
+		if (seen >= rank)
+			break;
+	}
+	if (b == 0)
+		return 0;
+	if (b == bucket_count-1 || ((uint64_t)1 << b) - 1 > s->max)
+		return s->max;
+	return ((uint64_t)1 << b) - 1;
+}
+
+int stats_dump(const char *path)
+{
+	FILE *fp = fopen(path, "w");
+	const struct histogram_t *s;
+	int h;
+
+	if (!fp)
+		return 0;
+
+	fprintf(fp, "# p50 and p99 are the tops of their power of 2 buckets\n");
+	fprintf(fp, "%-12s %10s %12s %12s %12s %12s\n",
+			"histogram", "count", "mean", "p50", "p99", "max");
+	for (h = 0; h < stats_count; h++) {
+		s = &histograms[h];
+		fprintf(fp, "%-12s %10lu %12.0f %12lu %12lu %12lu\n",
+				histogram_names[h], s->count,
+				s->count ? (double)s->sum / s->count : 0.0,
+				(unsigned long)percentile(s, 50),
+				(unsigned long)percentile(s, 99), (unsigned long)s->max);
+	}
+
+	return fclose(fp) == 0;
+}
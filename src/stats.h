@@ -0,0 +1,43 @@
+#ifndef SENTRY_H_STATS
+#define SENTRY_H_STATS
+
+/* Game loop instrumentation, built only with make STATS=1 (TETRIS_STATS).
+ * Every histogram has log2 buckets, so recording is a clock read and an
+ * increment. Without TETRIS_STATS the macros below expand to nothing.
+ */
+
+enum stats_histogram {
+	stats_read,			/* read(2) of a key, ns */
+	stats_logic,		/* engine steps and drawing to the back buffer, ns */
+	stats_flush,		/* render_flush(), ns */
+	stats_tick,			/* a loop wakeup from poll() to its frame out, ns */
+	stats_latency,		/* a key read to its frame out, ns */
+	stats_bytes,		/* bytes written per wakeup */
+	stats_count
+};
+
+#if TETRIS_STATS
+
+#include <stdint.h> /* uint64_t */
+
+void stats_start_clock(enum stats_histogram h);
+void stats_stop_clock(enum stats_histogram h);
+void stats_record(enum stats_histogram h, uint64_t value);
+void stats_record_total(enum stats_histogram h, uint64_t total);
+/* writes p50/p99/max of every histogram over path, returns 0 on failure */
+int stats_dump(const char *path);
+
+/* a stop without a start since the last stop records nothing */
+#define stats_start(h) stats_start_clock(h)
+#define stats_stop(h) stats_stop_clock(h)
+/* records how much a running total grew since the last call */
+#define stats_total(h, total) stats_record_total(h, total)
+
+#else
+
+#define stats_start(h) ((void)0)
+#define stats_stop(h) ((void)0)
+#define stats_total(h, total) ((void)0)
+
+#endif
+#endif
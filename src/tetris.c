@@ -4,78 +4,46 @@
 #include <stdio.h>
 #include <time.h> /* time */
 #include <conio.h>
+#include <stdlib.h> /* exit */
+#include <errno.h> /* errno */
 
 #else
 
-#include <stdio.h>
-#include <unistd.h> /* isatty, usleep */
+#include <stdio.h> /* fprintf, perror */
+#include <unistd.h> /* isatty, read, write */
 #include <sys/ioctl.h> /* ioctl */
 #include <stdlib.h> /* exit */
 #include <time.h> /* time */
 #include <termios.h> /* tcgetattr, tcsetattr */
 #include <fcntl.h> /* fcntl */
+#include <poll.h> /* poll */
+#include <signal.h> /* sigprocmask */
+#include <sys/timerfd.h> /* timerfd_create, timerfd_settime */
+#include <sys/signalfd.h> /* signalfd */
+#include <stdint.h> /* uint64_t */
+#include <string.h> /* memcpy, strlen */
+#include <sys/socket.h> /* socket, connect */
+#include <sys/un.h> /* sockaddr_un */
+#include <errno.h> /* errno */
 
 #endif
 
-enum {
-	default_attr = 0,
-	blinking = 5,
-	font_white = 37,
-	font_cyan = 34,
-	font_red = 31,
-	font_purple = 35,
-	default_font = 39,
-	back_red = 41,
-	back_green = 42,
-	back_yellow = 43,
-	back_blue = 44,
-	back_magenta = 45,
-	back_cyan = 46,
-	back_light_gray = 47,
-	default_back = 49
-};
-
-enum { key_esc = 27, key_up = 0x415b1b, key_down = 0x425b1b, key_space = 32,
-	   key_right = 0x435b1b, key_left = 0x445b1b };
-
-enum { field_width = 26, field_height = 20, frame_width = 9, frame_height = 5 };
+#include "engine.h"
+#include "bot.h"
+#include "render.h"
+#include "view.h"
+#include "replay.h"
+#include "save.h"
+#include "gravity.h"
+#include "input.h"
+#include "stats.h"
+#include "cast.h"
+#include "events.h"
+#include "tetris.h"
+#include "server.h"
 
 enum { sec_as_millisec = 1000, sec_as_nanosec = 1000000000,
-	   sec_as_microsec = 1000000, fall_delay = 500 };   
-
-enum { w_game_over = 58, h_game_over = 5 };
-
-struct block_t {
-	int x, y;
-};
-
-struct tetromino_t {
-	struct block_t blocks[4];
-};
-
-struct map_t {
-	int x, y;
-	int max_x, max_y;
-	int font_color;
-};
-
-struct current_tetromino_t {
-	int which;
-	int x, y;
-	int back_color;
-};
-
-struct score_t {
-	int sc;
-	int multip;
-	int x, y;
-	int font_color;
-};
-
-struct frame_t {
-	int x, y;
-	int font_color;
-};
+	   sec_as_microsec = 1000000 };
 
 #if FOR_WINDOWS
 
@@ -90,396 +58,158 @@ struct win_t {
 
 static struct win_t win;
 
-#endif
+#else
 
-static struct map_t map;
-static struct current_tetromino_t curr_tetromino;
-static struct current_tetromino_t next_tetromino;
-static char grid[field_height][field_width] = { 0 };
-static struct score_t score = { 0 };
-static struct frame_t frame = { 0 };
-
-static const struct tetromino_t tetromines[28] = {
-	/* O-tetromino (square) */
-	{{ {0, 0}, {0, 1}, {2, 0}, {2, 1} }},
-	{{ {0, 0}, {0, 1}, {2, 0}, {2, 1} }},
-	{{ {0, 0}, {0, 1}, {2, 0}, {2, 1} }},
-	{{ {0, 0}, {0, 1}, {2, 0}, {2, 1} }},
-
-	/* I-tetromino */
-	{{ {2, 0}, {2, 1}, {2, 2}, {2, 3} }},
-	{{ {0, 0}, {2, 0}, {4, 0}, {6, 0} }},
-	{{ {4, 0}, {4, 1}, {4, 2}, {4, 3} }},
-	{{ {0, 0}, {2, 0}, {4, 0}, {6, 0} }},
-
-	/* S-tetromino */
-	{{ {2, 0}, {4, 0}, {0, 1}, {2, 1} }},
-	{{ {0, 0}, {0, 1}, {2, 1}, {2, 2} }},
-	{{ {2, 0}, {4, 0}, {0, 1}, {2, 1} }},
-	{{ {0, 0}, {0, 1}, {2, 1}, {2, 2} }},
-
-	/* Z-tetromino */
-	{{ {0, 0}, {2, 0}, {2, 1}, {4, 1} }},
-	{{ {2, 0}, {0, 1}, {2, 1}, {0, 2} }},
-	{{ {0, 0}, {2, 0}, {2, 1}, {4, 1} }},
-	{{ {2, 0}, {0, 1}, {2, 1}, {0, 2} }},
-
-	/* T-tetromino */
-	{{ {0, 0}, {2, 0}, {4, 0}, {2, 1} }},
-	{{ {2, 0}, {0, 1}, {2, 1}, {2, 2} }},
-	{{ {2, 0}, {0, 1}, {2, 1}, {4, 1} }},
-	{{ {0, 0}, {0, 1}, {2, 1}, {0, 2} }},
-
-	/* J-tetromino */
-	{{ {2, 0}, {2, 1}, {0, 2}, {2, 2} }},
-	{{ {0, 0}, {0, 1}, {2, 1}, {4, 1} }},
-	{{ {0, 0}, {2, 0}, {0, 1}, {0, 2} }},
-	{{ {0, 0}, {2, 0}, {4, 0}, {4, 1} }},
-
-	/* L-tetromino */
-	{{ {0, 0}, {0, 1}, {0, 2}, {2, 2} }},
-	{{ {0, 0}, {2, 0}, {4, 0}, {0, 1} }},
-	{{ {0, 0}, {2, 0}, {2, 1}, {2, 2} }},
-	{{ {4, 0}, {0, 1}, {2, 1}, {4, 1} }}
+struct loop_t {
+	int timer_fd, signal_fd;
+	unsigned long wakeups;
+	struct timespec start;
+	int cast_lost;		/* --cast had no room, the next frame is a keyframe */
+	int out_flags;		/* of stdout before the game */
 };
 
-static const char *game_over_logo[5] = {
-"   ____                            ___                    ",
-"  / ___|  __ _  _ __ ___    ___   / _ \\ __   __ ___  _ __ ",
-" | |  _  / _` || '_ ` _ \\  / _ \\ | | | |\\ \\ / // _ \\| '__|",
-" | |_| || (_| || | | | | ||  __/ | |_| | \\ V /|  __/| |   ",
-"  \\____| \\__,_||_| |_| |_| \\___|  \\___/   \\_/  \\___||_|   " };                                                        
-
-inline static void hide_cursor()
-{
-	printf("\x1b[?25l");
-}
-
-inline static void set_cursor(int x, int y)
-{
-	printf("\x1b[%d;%dH", y, x);
-}
-
-inline static void show_cursor()
-{
-	printf("\x1b[?25h");
-}
-
-inline static void clear_screen()
-{
-	printf("\x1b[2J");
-}
-
-inline static void set_color(int color)
-{
-	printf("\x1b[%dm", color);
-}
+static struct loop_t loop;
+static struct replay_t replay;
+static struct input_t keys;
 
-static void clean_tetromino_frame()
-{
-	int i, w = next_tetromino.which;
-	int offset_x = 2, offset_y = 1;
+#endif
 
-	for (i = 0; i <4; i++) {
-		if (tetromines[w].blocks[i].x > 2)
-			offset_x = 0;
-		if (tetromines[w].blocks[i].y > 2)
-			offset_y = 0;
-	}
+/* room for a game of any size */
+static struct engine_any_t game_room;
+static struct engine_t *const game = &game_room.e;
+static struct gravity_t gravity;
+static struct view_t view;
+static struct game_options_t options;
+static struct bot_t bot;
+
+#if !FOR_WINDOWS
+static void cast_text(const char *s);
+static void flush_screen();
+static void log_event(struct event_t *ev, int kind, const struct piece_t *p,
+					  long value);
+static int log_input(enum engine_input in);
+#endif
 
-	for (i = 0; i < 4; i++) {
-		set_cursor(tetromines[w].blocks[i].x + frame.x+1+offset_x,
-				   tetromines[w].blocks[i].y + frame.y+1+offset_y);
-		printf("  ");
-	}
-}
+#if FOR_WINDOWS
 
-static void print_tetromino_frame()
+static void print_text(const char *s)
 {
-	int i, w = next_tetromino.which;
-	int offset_x = 2, offset_y = 1;
-
-	for (i = 0; i <4; i++) {
-		if (tetromines[w].blocks[i].x > 2)
-			offset_x = 0;
-		if (tetromines[w].blocks[i].y > 2)
-			offset_y = 0;
-	}
-
-	set_color(next_tetromino.back_color);
-	for (i = 0; i < 4; i++) {
-		set_cursor(tetromines[w].blocks[i].x + frame.x+1+offset_x,
-				   tetromines[w].blocks[i].y + frame.y+1+offset_y);
-		printf("  ");
-	}
-	set_color(default_back);
+	fputs(s, stdout);
+	fflush(stdout);
 }
 
-static void print_frame()
-{
-	int x, y, max_x, max_y;
-
-	max_x = frame.x + frame_width;
-	max_y = frame.y + frame_height;
-
-	set_color(frame.font_color);
-	/* 4 is "Next" */
-	set_cursor((frame.x + ((frame_width-4)/2+1)), frame.y-1);
-	printf("Next");
-
-	for (y = frame.y; y <= max_y; y++) {
-		for (x = frame.x; x <= max_x; x++) {
-			set_cursor(x, y);
-
-#if FOR_WINDOWS
-
-			if (x == frame.x && y == frame.y)
-				printf("*");
-			else if (x == max_x && y == frame.y)
-				printf("*");
-			else if (x == frame.x && y == max_y)
-				printf("*");
-			else if (x == max_x && y == max_y)
-				printf("*");
-			else if (x == frame.x || x == max_x) {
-				printf("|");
-			}
-			else if (y == frame.y || y == max_y) {
-				printf("-");
-			}
-			else
-				putchar(' ');
-
 #else
 
-			if (x == frame.x && y == frame.y)
-				printf("┌");
-			else if (x == max_x && y == frame.y)
-				printf("┐");
-			else if (x == frame.x && y == max_y)
-				printf("└");
-			else if (x == max_x && y == max_y)
-				printf("┘");
-			else if (x == frame.x || x == max_x) {
-				printf("│");
-			}
-			else if (y == frame.y || y == max_y) {
-				printf("─");
-			}
-			else
-				putchar(' ');
-
-#endif
+/* terminal control text, one write() and no stdio; it goes to --cast too.
+ * Never while a frame is pending, the text would land inside it.
+ */
+static void print_text(const char *s)
+{
+	struct pollfd out;
+	const char *p = s;
+	int n, len = (int)strlen(s);
+
+	out.fd = 1;
+	out.events = POLLOUT;
+	while (len > 0) {
+		n = write(1, p, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			/* stdout is non-blocking in the game, the text waits for
+			 * the terminal all the same
+			 */
+			if ((errno == EAGAIN || errno == EWOULDBLOCK)
+				&& poll(&out, 1, -1) >= 0)
+				continue;
+			break;
 		}
+		p += n;
+		len -= n;
 	}
-	set_color(default_font);
+	if (options.cast)
+		cast_text(s);
 }
 
-static void print_score()
-{
-	score.sc = score.sc + (score.multip * 100);
-	score.multip = 0;
-
-	/* clean score */
-	set_cursor(score.x, score.y);
-	printf("               ");
-
-	set_color(score.font_color);
-	set_cursor(score.x, score.y);
-	printf("Score: %d", score.sc);
-	set_color(default_font);
-}
+#endif
 
-static void print_help()
+inline static void hide_cursor()
 {
-	set_cursor(map.x-25, map.y);
-	printf("L-arrow or a: left");
-	set_cursor(map.x-25, map.y+1);
-	printf("R-arrow or d: right");
-	set_cursor(map.x-25, map.y+2);
-	printf("D-arrow or s: down");
-	set_cursor(map.x-25, map.y+3);
-	printf("U-arrow or r: rotate");
-	set_cursor(map.x-25, map.y+4);
-	printf("Esc or q: quit");
-	set_cursor(map.x-25, map.y+5);
-	printf("Space: pause");
+	print_text("\x1b[?25l");
 }
 
-static void print_map()
+/* the cursor home and shown on a cleared screen */
+inline static void reset_screen()
 {
-	int x, y;
-
-	clear_screen();
-	set_color(map.font_color);
-	for (y = map.y; y <= map.max_y; y++) {
-		for (x = map.x; x <= map.max_x; x++) {
-			if (x == map.x || x == map.max_x) {
-				set_cursor(x, y);
-				putchar('|');
-			}
-			else
-				putchar('.');
-		}
-	}
-	set_color(default_font);
+	print_text("\x1b[H\x1b[?25h\x1b[2J");
 }
 
-static void clean_tetromino()
+static int apply_input(enum engine_input in)
 {
-	int i, w = curr_tetromino.which;
-
-	for (i = 0; i < 4; i++) {
-		set_cursor(tetromines[w].blocks[i].x + curr_tetromino.x,
-				   tetromines[w].blocks[i].y + curr_tetromino.y);
-		printf("..");
-	}
-}
-
-static void print_tetromino()
-{
-	int i, w = curr_tetromino.which;
-
-	set_color(curr_tetromino.back_color);
-	for (i = 0; i < 4; i++) {
-		set_cursor(tetromines[w].blocks[i].x + curr_tetromino.x,
-				   tetromines[w].blocks[i].y + curr_tetromino.y);
-		printf("  ");
-	}
-	set_color(default_back);
+#if !FOR_WINDOWS
+	if (options.events)
+		return log_input(in);
+#endif
+	return view_input(&view, in);
 }
 
-static int is_collision(int dx, int dy)
+/* --autoplay: the bot places one piece, its moves go through feed */
+static int autoplay_piece(int (*feed)(enum engine_input))
 {
-	int i, w = curr_tetromino.which;
-
-	for (i = 0; i < 4; i++) {
-		int x = tetromines[w].blocks[i].x + dx;
-		int y = tetromines[w].blocks[i].y + dy;
-		
-		/* -1 to make the index in the array start from 0 */
-		int field_x = x - map.x-1;
-		int field_y = y - map.y;
+	enum engine_input moves[bot_max_moves];
+	int i, n, res = 0;
 
-		/* map.max_y+1 because there is no visible border */
-		if (map.x >= x || x >= map.max_x || y >= map.max_y+1
-			|| grid[field_y][field_x])
-			return 1;
+	n = bot_plan(&bot, game, moves);
+	if (!n) {
+		moves[0] = input_drop;
+		n = 1;
 	}
+	for (i = 0; i < n && !(res & step_game_over); i++)
+		res = feed(moves[i]);
 
-	return 0;
+	return res;
 }
 
-static void new_tetromino(struct current_tetromino_t *curr_tetro)
+/* --resume: returns 1 with the saved game, 0 if there is none yet and a
+ * new game starts
+ */
+static int resume_game()
 {
-	int which, seed;
-
-	/* If the remainder is 0, then add one to offset from the map border.
-	 * If the remainder is max, then result (if field_width = 26) is 18 (17+1),
-	 * but the result must be an odd number for tetramino to align correctly.
-	 */
-	seed = (rand() % (field_width-8)) + 1;
-	which = rand() % 28;
-	
-	if (seed % 2 == 0)
-	 		seed++;
-
-	curr_tetro->which = which;
-	curr_tetro->x = map.x + seed;
-	curr_tetro->y = map.y;
-	curr_tetro->back_color = back_red + (which / 4);
-}
-
-void clean_full_lines()
-{
-	int x, y, field_x, field_y;
-
-	for (y = map.y; y <= map.max_y; y++) {
-		field_y = y - map.y;
-		for (x = map.x+1; x < map.max_x; x += 2) {
-			field_x = x - map.x-1;
-			if (grid[field_y][field_x]) {
-				set_cursor(x, y);
-				set_color(grid[field_y][field_x]);
-				printf("  ");
-				set_color(default_back);
-			}
-			else {
-				set_cursor(x, y);
-				printf("..");
-
-			}
-		}
+	int res;
+
+	if (!options.resume)
+		return 0;
+	res = save_read(options.resume, game);
+	if (res == 0 && errno == ENOENT)
+		return 0;
+	if (res == 0) {
+		perror(options.resume);
+		exit(1);
 	}
-}
-
-void remove_full_lines()
-{
-	int x, y, x2, y2, field_x, field_y;
-
-	/* walk across entire map field and find full lines */
-	for (y = map.y; y <= map.max_y; y++) {
-		int full = 1;
-		field_y = y - map.y;
-		for (x = map.x+1; x < map.max_x; x += 2) {
-			/* -1 to make the index in the array start from 0 */
-			field_x = x - map.x-1;
-			if (!grid[field_y][field_x]) {
-				full = 0;
-				break;
-			}
-		}
-
-		if (full) {
-			score.multip++;
-			/* instead of full line, place all top lines, except map.y */
-			for (y2 = y; y2 > map.y; y2--) {
-				field_y = y2 - map.y;
-				for (x2 = map.x+1; x2 < map.max_x; x2 += 2) {
-					field_x = x2 - map.x-1;
-					grid[field_y][field_x] = grid[field_y-1][field_x];
-				}
-			}
-			/* clear the topmost line (necessary when tetramino fills
-			 * the topmost line and any bottom line is erased
-			 */
-			for (x2 = map.x+1; x2 < map.max_x; x2 += 2) {
-				int field_x = x2 - map.x-1;
-				grid[0][field_x] = 0;
-			}
-		}
+	if (res < 0) {
+		fprintf(stderr, "init_game: %s is not a game saved by this build\n",
+				options.resume);
+		exit(1);
 	}
-	clean_full_lines();
-}
-
-static void lock_tetromino()
-{
-	int i, w = curr_tetromino.which;
-
-	for (i = 0; i < 4; i++) {
-		/* -1 to make the index in the array start from 0 */
-		int field_x = (tetromines[w].blocks[i].x + curr_tetromino.x) - map.x-1;
-		int field_y = (tetromines[w].blocks[i].y + curr_tetromino.y) - map.y;
-		
-		if (field_y >= 0)
-			grid[field_y][field_x] = (char)curr_tetromino.back_color;
+	if (options.autoplay
+		&& (game->width != board_width || game->height != board_height)) {
+		fprintf(stderr, "init_game: --autoplay needs the standard %dx%d "
+				"board\n", board_width, board_height);
+		exit(1);
 	}
+	return 1;
 }
 
-void rotate_tetromino()
+/* --save: a game that ended leaves nothing to resume */
+static void save_game()
 {
-	int old_w, w;
-
-	old_w = curr_tetromino.which;
-
-	w = (curr_tetromino.which+1) % 4;
-	if (w == 0)
-		curr_tetromino.which -= 3;
-	else
-		curr_tetromino.which++;
-
-	if(is_collision(curr_tetromino.x, curr_tetromino.y))
-		curr_tetromino.which = old_w;
+	if (!options.save)
+		return;
+	if (game->game_over) {
+		if (remove(options.save) != 0 && errno != ENOENT)
+			perror(options.save);
+	} else if (!save_write(options.save, game))
+		perror(options.save);
 }
 
 #if FOR_WINDOWS
@@ -509,17 +239,18 @@ static void set_terminal_win()
 
 void restore_game_win()
 {
-	set_cursor(0, 0);
-    show_cursor();
-    clear_screen();
+	reset_screen();
 
 	SetConsoleMode(win.out, win.cls_mode_out);
+	save_game();
+	if (options.autoplay)
+		bot_free(&bot);
 }
 
-void init_game_win()
+void init_game_win(const struct game_options_t *opts)
 {
 	CONSOLE_SCREEN_BUFFER_INFO win_info;
-	int offset_x, offset_y;
+	int min_width, min_height;
 
 	win.out = GetStdHandle(STD_OUTPUT_HANDLE);
 	if (win.out == INVALID_HANDLE_VALUE) {
@@ -531,64 +262,42 @@ void init_game_win()
 	win.width = win_info.srWindow.Right - win_info.srWindow.Left + 1;
 	win.height = win_info.srWindow.Bottom - win_info.srWindow.Top + 1;
 
-	if (win.width < 79 || win.height < 23) {
+	options = *opts;
+	if (!resume_game()) {
+		engine_init_size(game,
+						 opts->has_seed ? opts->seed : (unsigned int)time(NULL),
+						 (enum randomizer_t)opts->randomizer, opts->width,
+						 opts->height);
+		game->gravity = opts->gravity;
+	}
+
+	view_min_size(game->width, game->height, &min_width, &min_height);
+	if (win.width < min_width || win.height < min_height) {
 		fprintf(stderr, "init_game: increase the window size. "
-			"Minimum screen size 80x24\n");
+			"Minimum screen size %dx%d\n", min_width, min_height);
 		Sleep(3000);
 		exit(1);
 	}
 
 	set_terminal_win();
 
-    /* offset_x + field_width+2 + offset_x */
-	offset_x = (win.width - (field_width+2))/2;
-	map.x = offset_x + 1;
-	map.max_x = offset_x + field_width+2;
-
-	/* offset_y + field_height + offset_y */
-	offset_y = (win.height - field_height)/2;
-	map.y = offset_y + 1;
-	map.max_y = offset_y + field_height;
-
-	map.font_color = font_white;
-
-	print_map();
-
-	srand((int)time(NULL));
-	new_tetromino(&curr_tetromino);
-	new_tetromino(&next_tetromino);
-	print_tetromino();
-
-	frame.x = map.max_x + 2;
-	frame.y = map.y+1; /* +1 for "Next" text */
-	frame.font_color = font_purple;
-	print_frame();
-	print_tetromino_frame();
-
-	score.x = frame.x;
-	score.y = frame.y + frame_height + 2;
-	score.font_color = font_red;
-	print_score();
+	if (opts->autoplay && !bot_init(&bot, 1, bot_default_beam)) {
+		fprintf(stderr, "init_game: out of memory\n");
+		exit(1);
+	}
 
-	print_help();
+	if (!view_init(&view, game, 1, win.width, win.height)) {
+		fprintf(stderr, "init_game: out of memory\n");
+		exit(1);
+	}
 	hide_cursor();
-	fflush(stdout);
+	render_flush(&view.screen);
 }
 
 static void end_game_win()
 {
-	int i, x, y;
-
-	x = ((win.width - w_game_over) / 2) + 1;
-	y = ((win.height - h_game_over) / 2) + 1;
-
-	clear_screen();
-
-	for (i = 0; i < h_game_over; i++) {
-		set_cursor(x, y+i);
-		printf("%s", game_over_logo[i]);
-	}
-	fflush(stdout);
+	view_game_over(&view);
+	render_flush(&view.screen);
 	Sleep(2000);
 }
 
@@ -597,9 +306,9 @@ static void pause_game_win()
 	int pause_game = 1;
 	int c;
 
-	set_cursor(map.x-5, map.y-2);
-	printf("game is paused, press space to continue");
-	fflush(stdout);
+	view_pause(&view, 1);
+	render_flush(&view.screen);
+	gravity_pause(&gravity, gravity_now());
 
 	while (pause_game) {
 		if (_kbhit() != 0) {
@@ -619,16 +328,29 @@ static void pause_game_win()
 		Sleep(30);
 	}
 
-	set_cursor(map.x-5, map.y-2);
-	printf("                                       ");
-	fflush(stdout);
+	gravity_resume(&gravity, gravity_now());
+	view_pause(&view, 0);
+	render_flush(&view.screen);
+}
+
+/* ms to sleep for keys, never past the gravity deadline */
+static DWORD key_wait()
+{
+	uint64_t now = gravity_now();
+	unsigned long ms;
+
+	if (gravity_due(&gravity, now))
+		return 0;
+	ms = (unsigned long)((gravity.deadline - now) / 1000000);
+	return ms < 30 ? ms : 30;
 }
 
 void start_game_win()
 {
 	int game_over = 0, key;
-	int elapsed_ms = 0;
+	uint64_t now;
 
+	gravity_start(&gravity, options.curve, game, gravity_now());
 	while (!game_over) {
 		if (_kbhit() != 0) {
 			/* getch returns 0 or 224 to indicate that next key is special */
@@ -637,56 +359,37 @@ void start_game_win()
 				key = _getch();
 				switch(key) {
 				case c_up:
-					clean_tetromino();
-					rotate_tetromino();
-					print_tetromino();
+					apply_input(input_rotate);
 					break;
 				case c_down:
-					if (!is_collision(curr_tetromino.x, curr_tetromino.y+1)) {
-						clean_tetromino();
-						curr_tetromino.y++;
-						print_tetromino();
-					}
+					apply_input(input_down);
 					break;
 				case c_right:
-					if (!is_collision(curr_tetromino.x+2, curr_tetromino.y)) {
-						clean_tetromino();
-						curr_tetromino.x += 2;
-						print_tetromino();
-					}
+					apply_input(input_right);
 					break;
 				case c_left:
-					if (!is_collision(curr_tetromino.x-2, curr_tetromino.y)) {
-						clean_tetromino();
-						curr_tetromino.x -= 2;
-						print_tetromino();
-					}
+					apply_input(input_left);
 					break;
 				}
 			} else {
 				switch(key) {
 				case 's':
 				case 'S':
-					if (!is_collision(curr_tetromino.x, curr_tetromino.y+1)) {
-						clean_tetromino();
-						curr_tetromino.y++;
-						print_tetromino();
-					}
+					apply_input(input_down);
 					break;
 				case 'd':
 				case 'D':
-					if (!is_collision(curr_tetromino.x+2, curr_tetromino.y)) {
-						clean_tetromino();
-						curr_tetromino.x += 2;
-						print_tetromino();
-					}
+					apply_input(input_right);
 					break;
 				case 'a':
 				case 'A':
-					if (!is_collision(curr_tetromino.x-2, curr_tetromino.y)) {
-						clean_tetromino();
-						curr_tetromino.x -= 2;
-						print_tetromino();
+					apply_input(input_left);
+					break;
+				case 'w':
+				case 'W':
+					if (apply_input(input_drop) & step_game_over) {
+						end_game_win();
+						game_over = 1;
 					}
 					break;
 				case key_esc:
@@ -696,9 +399,7 @@ void start_game_win()
 					break;
 				case 'r':
 				case 'R':
-					clean_tetromino();
-					rotate_tetromino();
-					print_tetromino();
+					apply_input(input_rotate);
 					break;
 				case key_space:
 					pause_game_win();
@@ -708,32 +409,20 @@ void start_game_win()
 
 		}
 
-        if (elapsed_ms > fall_delay) {
-            if (!is_collision(curr_tetromino.x, curr_tetromino.y+1)) {
-				clean_tetromino();
-				curr_tetromino.y++;
-				print_tetromino();
-			} else {
-				lock_tetromino();
-				remove_full_lines();
-				print_score();
-				curr_tetromino = next_tetromino;
-				clean_tetromino_frame();
-				new_tetromino(&next_tetromino);
-				print_tetromino_frame();
-				if (is_collision(curr_tetromino.x, curr_tetromino.y)) {
-					end_game_win();
-					game_over = 1;
-				} else
-					print_tetromino();
+		/* every step that is due, each deadline follows the last one */
+		now = gravity_now();
+		while (!game_over && gravity_due(&gravity, now)) {
+			if ((options.autoplay ? autoplay_piece(apply_input)
+				 : apply_input(input_tick)) & step_game_over) {
+				end_game_win();
+				game_over = 1;
 			}
-			elapsed_ms = 0;
+			gravity_next(&gravity, game);
 		}
 
-		fflush(stdout);
-		/* 30 ms (30000 microsec = 30 000 * 10^-3 ms = 30 ms) */
-		Sleep(30);
-		elapsed_ms += 30;
+		render_flush(&view.screen);
+		/* keys are polled every 30 ms at most */
+		Sleep(key_wait());
 	}
 }
 
@@ -749,10 +438,147 @@ static void set_terminal()
     tcsetattr(0, TCSANOW, &ts);
 }
 
-void init_game()
+/* The loop never waits for the terminal: a frame stdout does not take at
+ * once goes out as poll() finds it writable, and the frames drawn
+ * meanwhile are merged into the one after it (see render.h).
+ */
+static void set_output()
+{
+	loop.out_flags = fcntl(1, F_GETFL);
+	if (loop.out_flags != -1)
+		fcntl(1, F_SETFL, loop.out_flags | O_NONBLOCK);
+}
+
+/* stdout for the poll() of a loop, left out unless a frame is pending */
+static void watch_output(struct pollfd *fd)
+{
+	fd->fd = render_pending(&view.screen) ? 1 : -1;
+	fd->events = POLLOUT;
+}
+
+/* gravity comes from a timerfd and signals from a signalfd, so the game
+ * loop can sleep in poll() until something happens; with resize the loop
+ * gets SIGWINCH too
+ */
+static void set_events(int resize)
+{
+	sigset_t mask;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGHUP);
+	if (resize)
+		sigaddset(&mask, SIGWINCH);
+#if TETRIS_STATS
+	if (options.stats)
+		sigaddset(&mask, SIGUSR1);
+#endif
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+
+	loop.signal_fd = signalfd(-1, &mask, SFD_CLOEXEC);
+	/* a pause can leave the timer readable but not expired */
+	loop.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	if (loop.signal_fd == -1 || loop.timer_fd == -1) {
+		perror("init_game: signalfd/timerfd");
+		exit(1);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &loop.start);
+}
+
+static void arm_timer(int ms, int periodic)
+{
+	struct itimerspec its;
+
+	its.it_value.tv_sec = ms / sec_as_millisec;
+	its.it_value.tv_nsec = (ms % sec_as_millisec) * (sec_as_nanosec / sec_as_millisec);
+	its.it_interval.tv_sec = periodic ? its.it_value.tv_sec : 0;
+	its.it_interval.tv_nsec = periodic ? its.it_value.tv_nsec : 0;
+	timerfd_settime(loop.timer_fd, 0, &its, NULL);
+}
+
+/* 0 stops the timer */
+static void set_timer(int ms)
+{
+	arm_timer(ms, 1);
+}
+
+static void set_timer_once(int ms)
+{
+	arm_timer(ms, 0);
+}
+
+/* the gravity deadline, on the clock of gravity_now() */
+static void set_deadline(uint64_t ns)
+{
+	struct itimerspec its;
+
+	its.it_value.tv_sec = (time_t)(ns / sec_as_nanosec);
+	its.it_value.tv_nsec = (long)(ns % sec_as_nanosec);
+	its.it_interval.tv_sec = 0;
+	its.it_interval.tv_nsec = 0;
+	/* 0 would stop the timer, a deadline of 0 has passed anyway */
+	if (!its.it_value.tv_sec && !its.it_value.tv_nsec)
+		its.it_value.tv_nsec = 1;
+	timerfd_settime(loop.timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/* a new game, the one in the replay file or the saved one */
+static void init_engine()
+{
+	unsigned int seed;
+
+	if (options.replay) {
+		if (!replay_open(&replay, options.replay)) {
+			fprintf(stderr, "init_game: cannot read replay %s\n",
+					options.replay);
+			exit(1);
+		}
+		engine_init_size(game, replay.seed,
+						 (enum randomizer_t)replay.randomizer, replay.width,
+						 replay.height);
+		game->gravity = replay.gravity;
+		if (options.seek && !replay_seek(&replay, game, options.seek)) {
+			fprintf(stderr, "init_game: the replay ends before piece %lu\n",
+					options.seek);
+			exit(1);
+		}
+		return;
+	}
+	if (resume_game())
+		return;
+
+	seed = options.has_seed ? options.seed : (unsigned int)time(NULL);
+	engine_init_size(game, seed, (enum randomizer_t)options.randomizer,
+					 options.width, options.height);
+	game->gravity = options.gravity;
+	if (options.record && !replay_create(&replay, options.record, game, seed)) {
+		perror(options.record);
+		exit(1);
+	}
+}
+
+/* --events starts with the piece on the board */
+static void open_events()
+{
+	struct event_t ev;
+
+	if (!events_open(options.events, game->width, game->height)) {
+		perror(options.events);
+		exit(1);
+	}
+	ev.ns = gravity_now();
+	ev.piece = game->pieces;
+	ev.input = input_none;
+	ev.lines = 0;
+	log_event(&ev, event_spawn, &game->curr, 0);
+	events_publish();
+}
+
+void init_game(const struct game_options_t *opts)
 {
 	struct winsize w;
-	int offset_x, offset_y;
+	int min_width, min_height;
 
 	if (!isatty(0)) {
         fprintf(stderr, "init_game: not a terminal\n");
@@ -761,50 +587,103 @@ void init_game()
 
     ioctl(0, TIOCGWINSZ, &w);
 
-	if (w.ws_col < 79 || w.ws_row < 23) {
+	options = *opts;
+	init_engine();
+	view_min_size(game->width, game->height, &min_width, &min_height);
+	if (w.ws_col < min_width || w.ws_row < min_height) {
 		fprintf(stderr, "init_game: increase the window size. " 
-			"Minimum screen size 80x24\n");
+			"Minimum screen size %dx%d\n", min_width, min_height);
+		exit(1);
+	}
+	if (options.autoplay
+		&& !bot_init(&bot, (int)sysconf(_SC_NPROCESSORS_ONLN),
+					 bot_default_beam)) {
+		fprintf(stderr, "init_game: cannot start the bot\n");
 		exit(1);
 	}
-
     set_terminal();
+	set_events(1);
+	input_init(&keys);
 
-    /* offset_x + field_width+2 + offset_x */
-	offset_x = (w.ws_col - (field_width+2))/2;
-	map.x = offset_x + 1;
-	map.max_x = offset_x + field_width+2;
+	if (!view_init(&view, game, 1, w.ws_col, w.ws_row)) {
+		fprintf(stderr, "init_game: out of memory\n");
+		exit(1);
+	}
+	if (options.cast && !cast_open(options.cast, w.ws_col, w.ws_row)) {
+		perror(options.cast);
+		exit(1);
+	}
+	if (options.events)
+		open_events();
+	/* last, an exit above leaves stdout as the shell had it */
+	set_output();
+	hide_cursor();
+	flush_screen();
+}
 
-	/* offset_y + field_height + offset_y */
-	offset_y = (w.ws_row - field_height)/2;
-	map.y = offset_y + 1;
-	map.max_y = offset_y + field_height;
+static time_t diff_timestamps(const struct timespec *start, const struct timespec *end)
+{
+	struct timespec tmp;
 
-	map.font_color = font_white;
+	if (end->tv_nsec - start->tv_nsec < 0) {
+		tmp.tv_sec = end->tv_sec - start->tv_sec - 1;
+		tmp.tv_nsec = end->tv_nsec - start->tv_nsec + sec_as_nanosec;
+	}
+	else {
+		tmp.tv_sec = end->tv_sec - start->tv_sec;
+		tmp.tv_nsec = end->tv_nsec - start->tv_nsec;
+	}
 
-	print_map();
+	return tmp.tv_sec * sec_as_millisec + tmp.tv_nsec / sec_as_microsec;
+}
 
-	srand(time(NULL));
-	new_tetromino(&curr_tetromino);
-	new_tetromino(&next_tetromino);
-	print_tetromino();
+static unsigned long game_clock()
+{
+	struct timespec now;
 
-	frame.x = map.max_x + 2;
-	frame.y = map.y+1; /* +1 for "Next" text */
-	frame.font_color = font_purple;
-	print_frame();
-	print_tetromino_frame();
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (unsigned long)diff_timestamps(&loop.start, &now);
+}
 
-	score.x = frame.x;
-	score.y = frame.y + frame_height + 2;
-	score.font_color = font_red;
-	print_score();
+/* output --cast has no room for is lost, the next frame is drawn whole
+ * instead
+ */
+static void cast_text(const char *s)
+{
+	if (!cast_output(game_clock(), s, (int)strlen(s)))
+		loop.cast_lost = 1;
+}
 
-	print_help();
-	hide_cursor();
-	fflush(stdout);
+/* render_flush() plus --cast */
+static void flush_screen()
+{
+	struct render_t *r = &view.screen;
+
+	if (render_flush(r) <= 0 || !options.cast)
+		return;
+	/* the keyframe takes the place of the frame, so not before that one
+	 * went out whole
+	 */
+	if (loop.cast_lost) {
+		if (render_pending(r) || render_keyframe(r) < 0)
+			return;
+	}
+	loop.cast_lost = !cast_output(game_clock(), r->out, r->out_len);
 }
 
-void restore_game()
+static void print_wakeups()
+{
+	struct timespec now;
+	time_t ms;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = diff_timestamps(&loop.start, &now);
+	fprintf(stderr, "wakeups: %lu in %ld.%03ld s (%.2f/s)\n", loop.wakeups,
+			(long)(ms / sec_as_millisec), (long)(ms % sec_as_millisec),
+			ms ? loop.wakeups * (double)sec_as_millisec / ms : 0.0);
+}
+
+static void restore_terminal()
 {
 	struct termios ts;
 
@@ -814,174 +693,493 @@ void restore_game()
     ts.c_cc[VTIME] = 0;
     tcsetattr(0, TCSANOW, &ts);
 
-    set_cursor(0, 0);
-    show_cursor();
-    clear_screen();
+	reset_screen();
 }
 
-static time_t diff_timestamps(const struct timespec *start, const struct timespec *end)
+static void close_events()
 {
-	struct timespec tmp;
+	unsigned long lost;
+
+	if (!events_close(&lost))
+		fprintf(stderr, "restore_game: cannot write events to %s\n",
+				options.events);
+	if (lost)
+		fprintf(stderr, "restore_game: %lu events lost, the consumer "
+				"fell behind\n", lost);
+}
 
-	if (end->tv_nsec - start->tv_nsec < 0) {
-		tmp.tv_sec = end->tv_sec - start->tv_sec - 1;
-		tmp.tv_nsec = end->tv_nsec - start->tv_nsec + sec_as_nanosec;
-	}
-	else {
-		tmp.tv_sec = end->tv_sec - start->tv_sec;
-		tmp.tv_nsec = end->tv_nsec - start->tv_nsec;
+void restore_game()
+{
+	/* blocking again, a pending frame and the changes behind it go out in
+	 * full before the screen is reset
+	 */
+	if (loop.out_flags != -1)
+		fcntl(1, F_SETFL, loop.out_flags);
+	if (render_pending(&view.screen))
+		flush_screen();
+	restore_terminal();
+	save_game();
+	if (options.cast && !cast_close())
+		fprintf(stderr, "restore_game: cannot write cast %s\n",
+				options.cast);
+	if (options.events)
+		close_events();
+	if (options.wakeups)
+		print_wakeups();
+	if (options.autoplay)
+		bot_free(&bot);
+#if TETRIS_STATS
+	if (options.stats && !stats_dump(options.stats))
+		perror(options.stats);
+#endif
+	if ((options.record || options.replay) && !replay_close(&replay)
+		&& options.record)
+		fprintf(stderr, "restore_game: cannot write replay %s\n",
+				options.record);
+}
+
+/* ev has the time, the input and the piece number already */
+static void log_event(struct event_t *ev, int kind, const struct piece_t *p,
+					  long value)
+{
+	ev->kind = (unsigned char)kind;
+	ev->x = p->x;
+	ev->y = p->y;
+	ev->which = (unsigned char)p->which;
+	ev->value = value;
+	events_push(ev);
+}
+
+/* view_input() plus --events: what the step did, as events of one time,
+ * published at once. A landing piece is only on the board afterwards, so
+ * where it lands is worked out before the step.
+ */
+static int log_input(enum engine_input in)
+{
+	struct piece_t landed = game->curr;
+	struct event_t ev;
+	int score = game->score, res;
+
+	if (in == input_drop || in == input_tick)
+		landed.y += engine_drop_distance(game, &landed);
+	ev.piece = game->pieces;
+	res = view_input(&view, in);
+	if (!res)
+		return res;
+
+	ev.ns = gravity_now();
+	ev.input = (unsigned char)in;
+	ev.lines = (unsigned char)(res & step_locked ? game->lines : 0);
+	if (res & step_moved)
+		log_event(&ev, in == input_rotate ? event_rotate : event_move,
+				  res & step_locked ? &landed : &game->curr, 0);
+	if (res & step_locked)
+		log_event(&ev, event_lock, &landed, 0);
+	if (res & step_lines)
+		log_event(&ev, event_lines, &landed, game->score - score);
+	if (game->score != score)
+		log_event(&ev, event_score, &landed, game->score);
+	if (res & step_game_over)
+		log_event(&ev, event_game_over, &landed, game->score);
+	else if (res & step_locked) {
+		ev.piece = game->pieces;
+		ev.lines = 0;
+		log_event(&ev, event_spawn, &game->curr, 0);
 	}
+	events_publish();
+	return res;
+}
 
-	return tmp.tv_sec * sec_as_millisec + tmp.tv_nsec / sec_as_microsec;
+/* apply_input() plus recording */
+static int play_input(enum engine_input in)
+{
+	int res = apply_input(in);
+
+	if (options.record)
+		replay_input(&replay, in, game_clock(), game);
+	return res;
 }
 
-static void pause_game()
+/* The layout follows the new size at once. The next flush clears the
+ * terminal, which has reflowed the old frame, and draws the cells that are
+ * not blank in one write.
+ */
+static void resize_screen()
 {
-	int pause_game = 1;
-	int c, n;
+	struct winsize w;
 
-	set_cursor(map.x-5, map.y-2);
-	printf("game is paused, press space to continue");
-	fflush(stdout);
+	if (ioctl(0, TIOCGWINSZ, &w) != 0
+		|| (w.ws_col == view.screen.width && w.ws_row == view.screen.height))
+		return;
+	if (!view_resize(&view, w.ws_col, w.ws_row)) {
+		fprintf(stderr, "resize_screen: out of memory\n");
+		return;
+	}
+	if (options.cast && !cast_resize(game_clock(), w.ws_col, w.ws_row))
+		loop.cast_lost = 1;
+}
 
-	while (pause_game) {
-		n = read(0, &c, 3);
+/* poll() waits input_esc_ms for the rest of a sequence, else for ever */
+static int key_timeout()
+{
+	return input_waiting(&keys) ? input_esc_ms : -1;
+}
 
-		if (n)
-			switch(c) {
-			case key_space:
-				pause_game = 0;
-				break;
-			case 'Q':
-			case 'q':
-			case key_esc:
-				restore_game();
-				exit(0);
-				break;
-			}
-		c = 0;
-		usleep(30000);
+/* returns 1 if the signal asks to quit */
+static int handle_signal()
+{
+	struct signalfd_siginfo si;
+
+	if (read(loop.signal_fd, &si, sizeof(si)) != sizeof(si))
+		return 0;
+
+	switch (si.ssi_signo) {
+	case SIGINT:
+	case SIGTERM:
+	case SIGHUP:
+		return 1;
+	case SIGWINCH:
+		resize_screen();
+		break;
+#if TETRIS_STATS
+	case SIGUSR1:
+		if (!stats_dump(options.stats))
+			perror(options.stats);
+		break;
+#endif
 	}
+	return 0;
+}
 
-	set_cursor(map.x-5, map.y-2);
-	printf("                                       ");
-	fflush(stdout);
+/* the timer is stopped while paused, so a paused game never wakes up on its
+ * own; a window too small for the game pauses it too, until it is large
+ * enough and the player resumes; returns 1 if the player quits
+ */
+static int pause_game()
+{
+	struct pollfd fds[3];
+	int c, n, quit = 0, resume = 0;
+
+	view_pause(&view, 1);
+	set_timer(0);
+	gravity_pause(&gravity, gravity_now());
+
+	fds[0].fd = 0;
+	fds[0].events = POLLIN;
+	fds[1].fd = loop.signal_fd;
+	fds[1].events = POLLIN;
+
+	for (;;) {
+		/* the keys after the one that paused come first, the keys after
+		 * the one that resumes are left to the game
+		 */
+		while (!quit && !resume && (c = input_next(&keys)) >= 0) {
+			if (c == key_space && view.fits)
+				resume = 1;
+			else if (c == 'q' || c == 'Q' || c == key_esc)
+				quit = 1;
+		}
+		if (quit || resume)
+			break;
+
+		flush_screen();
+		watch_output(&fds[2]);
+		n = poll(fds, 3, key_timeout());
+		if (n < 0)
+			continue;
+		loop.wakeups++;
+		if (n == 0)
+			input_timeout(&keys);
+
+		if (fds[1].revents & POLLIN && handle_signal())
+			quit = 1;
+		if (fds[0].revents & POLLIN)
+			input_read(&keys, 0);
+	}
+
+	view_pause(&view, 0);
+	flush_screen();
+	/* the replay sets the timer itself */
+	gravity_resume(&gravity, gravity_now());
+	if (!options.replay)
+		set_deadline(gravity.deadline);
+	return quit;
 }
 
 static void end_game()
 {
-	struct winsize w;
-	int i, x, y;
+	view_game_over(&view);
+	flush_screen();
+	sleep(2);
+}
 
-	ioctl(0, TIOCGWINSZ, &w);
+/* returns 1 when the game is over */
+static int handle_key(int key)
+{
+	switch(key) {
+	case 's':
+	case 'S':
+	case key_down:
+		play_input(input_down);
+		break;
+	case 'd':
+	case 'D':
+	case key_right:
+		play_input(input_right);
+		break;
+	case 'a':
+	case 'A':
+	case key_left:
+		play_input(input_left);
+		break;
+	case 'w':
+	case 'W':
+		if (play_input(input_drop) & step_game_over) {
+			end_game();
+			return 1;
+		}
+		break;
+	case key_esc:
+	case 'q':
+	case 'Q':
+		return 1;
+	case 'r':
+	case 'R':
+	case key_up:
+		play_input(input_rotate);
+		break;
+	case key_space:
+		return pause_game();
+	}
 
-	x = ((w.ws_col - w_game_over) / 2) + 1;
-	y = ((w.ws_row - h_game_over) / 2) + 1;
+	return 0;
+}
 
-	clear_screen();
+/* Plays the recorded inputs at the pace they were recorded, the keys can
+ * only pause or quit.
+ */
+static void play_replay()
+{
+	struct replay_record_t rec;
+	struct pollfd fds[4];
+	unsigned long base_ms = replay.last_ms, start_ms = game_clock();
+	unsigned long now, paused;
+	uint64_t expired;
+	int key, n, quit = 0;
+
+	fds[0].fd = 0;
+	fds[0].events = POLLIN;
+	fds[1].fd = loop.timer_fd;
+	fds[1].events = POLLIN;
+	fds[2].fd = loop.signal_fd;
+	fds[2].events = POLLIN;
+
+	while (!quit && replay_next(&replay, &rec)) {
+		while (!quit && (now = game_clock() - start_ms) < rec.ms - base_ms) {
+			set_timer_once((int)(rec.ms - base_ms - now));
+			flush_screen();
+			watch_output(&fds[3]);
+
+			n = poll(fds, 4, key_timeout());
+			if (n < 0)
+				continue;
+			loop.wakeups++;
+			if (n == 0)
+				input_timeout(&keys);
+
+			if (fds[2].revents & POLLIN && handle_signal())
+				quit = 1;
+			if (fds[1].revents & POLLIN)
+				read(loop.timer_fd, &expired, sizeof(expired));
+			if (!quit && !view.fits) {
+				paused = game_clock();
+				quit = pause_game();
+				start_ms += game_clock() - paused;
+			}
+			if (fds[0].revents & POLLIN)
+				input_read(&keys, 0);
+			while (!quit && (key = input_next(&keys)) >= 0) {
+				if (key == 'q' || key == 'Q' || key == key_esc)
+					quit = 1;
+				else if (key == key_space) {
+					paused = game_clock();
+					quit = pause_game();
+					start_ms += game_clock() - paused;
+				}
+			}
+		}
 
-	for (i = 0; i < h_game_over; i++) {
-		set_cursor(x, y+i);
-		printf("%s", game_over_logo[i]);
+		if (!quit && apply_input(rec.in) & step_game_over) {
+			end_game();
+			quit = 1;
+		}
 	}
-	fflush(stdout);
-	sleep(2);
+
+	set_timer(0);
 }
 
-/* 1 step of the cycle takes 30 ms, the reaction to key pressed occurs every 30
- * ms, after 17 steps of the cycle (30 ms * 17 = 510 ms + ~3 ms (cumulative
- * effect)) (the first step of the cycle will require 18 steps of the cycle
- * since the first step there is no 30 ms delay and the difference will be
- * 0 ms) tetromino falls down 1 cell
+/* The loop sleeps in poll() until a key arrives, the gravity timer expires,
+ * a signal comes or stdout can take more of a pending frame. Every key of a
+ * read is handled at once, in order, so keys are never merged or dropped
+ * however fast they come. The timer is set to the absolute deadline of the
+ * next fall step; when it fires, every step that is due by then is made,
+ * each deadline an interval of its level after the one before, so a late
+ * wakeup does not shift the pace.
  */
-
 void start_game()
 {
-	int n, game_over = 0, key = 0;
-	struct timespec t1, t2;
-	time_t elapsed_ms;
+	struct pollfd fds[4];
+	int game_over = 0, key, n;
+	uint64_t expired, now;
+
+	fds[0].fd = 0;
+	fds[0].events = POLLIN;
+	fds[1].fd = loop.timer_fd;
+	fds[1].events = POLLIN;
+	fds[2].fd = loop.signal_fd;
+	fds[2].events = POLLIN;
+
+	if (options.replay) {
+		play_replay();
+		return;
+	}
 
-	clock_gettime(CLOCK_MONOTONIC, &t1);
+	gravity_start(&gravity, options.curve, game, gravity_now());
+	set_deadline(gravity.deadline);
 
 	while (!game_over) {
-		n = read(0, &key, 3);
-		if (n) {
-			switch(key) {
-			case 's':
-			case 'S':
-			case key_down:
-				if (!is_collision(curr_tetromino.x, curr_tetromino.y+1)) {
-					clean_tetromino();
-					curr_tetromino.y++;
-					print_tetromino();
-				}
-				break;
-			case 'd':
-			case 'D':
-			case key_right:
-				if (!is_collision(curr_tetromino.x+2, curr_tetromino.y)) {
-					clean_tetromino();
-					curr_tetromino.x += 2;
-					print_tetromino();
-				}
-				break;
-			case 'a':
-			case 'A':
-			case key_left:
-				if (!is_collision(curr_tetromino.x-2, curr_tetromino.y)) {
-					clean_tetromino();
-					curr_tetromino.x -= 2;
-					print_tetromino();
-				}
-				break;
-			case key_esc:
-			case 'q':
-			case 'Q':
-				game_over = 1;
-				break;
-			case 'r':
-			case 'R':
-			case key_up:
-				clean_tetromino();
-				rotate_tetromino();
-				print_tetromino();
+		stats_start(stats_flush);
+		flush_screen();
+		stats_stop(stats_flush);
+		stats_stop(stats_tick);
+		stats_stop(stats_latency);
+		stats_total(stats_bytes, view.screen.bytes);
+		watch_output(&fds[3]);
+
+		n = poll(fds, 4, key_timeout());
+		if (n < 0)
+			continue;
+		stats_start(stats_tick);
+		loop.wakeups++;
+		if (n == 0)
+			input_timeout(&keys);
+
+		if (fds[2].revents & POLLIN && handle_signal())
+			break;
+		if (!view.fits) {
+			if (pause_game())
 				break;
-			case key_space:
-				pause_game();
-				break;
-			}
-			key = 0;
+			continue;
 		}
 
-        clock_gettime(CLOCK_MONOTONIC, &t2);
-        elapsed_ms = diff_timestamps(&t1, &t2);
+		if (fds[0].revents & POLLIN) {
+			stats_start(stats_latency);
+			stats_start(stats_read);
+			input_read(&keys, 0);
+			stats_stop(stats_read);
+		}
+		if (keys.count) {
+			stats_start(stats_logic);
+			while (!game_over && (key = input_next(&keys)) >= 0)
+				game_over = handle_key(key);
+			stats_stop(stats_logic);
+		}
 
-        if (elapsed_ms > fall_delay) {
-            if (!is_collision(curr_tetromino.x, curr_tetromino.y+1)) {
-				clean_tetromino();
-				curr_tetromino.y++;
-				print_tetromino();
-			} else {
-			 	lock_tetromino();
-			 	remove_full_lines();
-			 	print_score();
-			 	curr_tetromino = next_tetromino;
-			 	clean_tetromino_frame();
-			 	new_tetromino(&next_tetromino);
-			 	print_tetromino_frame();
-			 	if (is_collision(curr_tetromino.x, curr_tetromino.y)) {
-			 		end_game();
-			 		game_over = 1;
-			 	} else
-			 		print_tetromino();
+		if (!game_over && fds[1].revents & POLLIN) {
+			/* a pause may have moved the deadline, the clock decides */
+			read(loop.timer_fd, &expired, sizeof(expired));
+			stats_start(stats_logic);
+			now = gravity_now();
+			while (!game_over && gravity_due(&gravity, now)) {
+				if ((options.autoplay ? autoplay_piece(play_input)
+					 : play_input(input_tick)) & step_game_over) {
+					end_game();
+					game_over = 1;
+				}
+				gravity_next(&gravity, game);
 			}
-			t1 = t2;
+			stats_stop(stats_logic);
+			set_deadline(gravity.deadline);
 		}
+	}
+
+	set_timer(0);
+}
+
+/* The thin client of --server: the keys go to the socket as they are, the
+ * frames from it to the terminal, until the server hangs up.
+ */
+int connect_game(const char *path, long watch)
+{
+	struct sockaddr_un addr;
+	struct winsize w;
+	struct pollfd fds[3];
+	unsigned char hello[server_hello_size];
+	char buf[4096];
+	int fd, n, done = 0;
+
+	if (!isatty(0)) {
+		fprintf(stderr, "connect_game: not a terminal\n");
+		return 1;
+	}
+	ioctl(0, TIOCGWINSZ, &w);
 
-		fflush(stdout);
-		/* 30 ms (30000 microsec = 30 000 * 10^-3 ms = 30 ms) */
-		usleep(30000);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		perror(path);
+		return 1;
 	}
+
+	memcpy(hello, watch < 0 ? server_magic : server_watch_magic, 4);
+	hello[4] = w.ws_col & 0xff;
+	hello[5] = w.ws_col >> 8;
+	hello[6] = w.ws_row & 0xff;
+	hello[7] = w.ws_row >> 8;
+	if (watch < 0)
+		watch = 0;
+	hello[8] = watch & 0xff;
+	hello[9] = watch >> 8 & 0xff;
+	hello[10] = watch >> 16 & 0xff;
+	hello[11] = watch >> 24 & 0xff;
+	if (write(fd, hello, sizeof(hello)) != sizeof(hello)) {
+		perror(path);
+		return 1;
+	}
+
+	set_terminal();
+	set_events(0);
+	hide_cursor();
+
+	fds[0].fd = 0;
+	fds[0].events = POLLIN;
+	fds[1].fd = fd;
+	fds[1].events = POLLIN;
+	fds[2].fd = loop.signal_fd;
+	fds[2].events = POLLIN;
+
+	while (!done) {
+		if (poll(fds, 3, -1) < 0)
+			continue;
+		if (fds[2].revents & POLLIN && handle_signal())
+			break;
+		if (fds[0].revents & POLLIN) {
+			n = read(0, buf, sizeof(buf));
+			if (n > 0 && write(fd, buf, n) != n)
+				done = 1;
+		}
+		if (fds[1].revents & (POLLIN | POLLHUP)) {
+			n = read(fd, buf, sizeof(buf));
+			if (n <= 0 || write(1, buf, n) != n)
+				done = 1;
+		}
+	}
+
+	close(fd);
+	restore_terminal();
+	return 0;
 }
 
 #endif
@@ -1,17 +1,44 @@
 #ifndef SENTRY_H_TETRIS
 #define SENTRY_H_TETRIS
 
+struct game_options_t {
+	int gravity;		/* rows per fall step, board_max_height for 20G */
+	int curve;			/* enum gravity_curve, the time between steps */
+	int width, height;	/* of the board, in cells */
+	int wakeups;		/* report loop wakeups per second on exit */
+	const char *record;	/* replay file to write */
+	const char *replay;	/* replay file to play */
+	unsigned long seek;	/* piece to start the replay at */
+	int headless;		/* play the replay without the terminal */
+	unsigned int seed;
+	int has_seed;		/* else the seed is the time */
+	int randomizer;		/* enum randomizer_t */
+	int autoplay;		/* the bot plays a piece every fall step */
+	const char *stats;	/* loop histograms file, needs TETRIS_STATS */
+	const char *cast;	/* asciicast file of the terminal output */
+	const char *events;	/* file or Unix socket for the game events */
+	const char *save;	/* file to save the game to on quit */
+	const char *resume;	/* saved game to play, a new one if it is missing */
+	const char *server;	/* socket to serve games on */
+	const char *connect;	/* socket of a server to play on */
+	long watch;			/* game to watch on it, 0 the newest, -1 to play */
+};
+
 #if FOR_WINDOWS
 
-void init_game_win();
+void init_game_win(const struct game_options_t *opts);
 void start_game_win();
 void restore_game_win();
 
 #else
 
-void init_game();
+void init_game(const struct game_options_t *opts);
 void start_game();
 void restore_game();
+/* plays on a --server, or watches game watch if it is not -1; returns
+ * the exit code
+ */
+int connect_game(const char *path, long watch);
 
 #endif
 #endif
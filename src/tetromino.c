@@ -0,0 +1,45 @@
+#include "tetromino.h"
+
+const struct tetromino_t tetromines[tetromino_count] = {
+	/* O-tetromino (square) */
+	{{ {0, 0}, {0, 1}, {1, 0}, {1, 1} }},
+	{{ {0, 0}, {0, 1}, {1, 0}, {1, 1} }},
+	{{ {0, 0}, {0, 1}, {1, 0}, {1, 1} }},
+	{{ {0, 0}, {0, 1}, {1, 0}, {1, 1} }},
+
+	/* I-tetromino */
+	{{ {1, 0}, {1, 1}, {1, 2}, {1, 3} }},
+	{{ {0, 0}, {1, 0}, {2, 0}, {3, 0} }},
+	{{ {2, 0}, {2, 1}, {2, 2}, {2, 3} }},
+	{{ {0, 0}, {1, 0}, {2, 0}, {3, 0} }},
+
+	/* S-tetromino */
+	{{ {1, 0}, {2, 0}, {0, 1}, {1, 1} }},
+	{{ {0, 0}, {0, 1}, {1, 1}, {1, 2} }},
+	{{ {1, 0}, {2, 0}, {0, 1}, {1, 1} }},
+	{{ {0, 0}, {0, 1}, {1, 1}, {1, 2} }},
+
+	/* Z-tetromino */
+	{{ {0, 0}, {1, 0}, {1, 1}, {2, 1} }},
+	{{ {1, 0}, {0, 1}, {1, 1}, {0, 2} }},
+	{{ {0, 0}, {1, 0}, {1, 1}, {2, 1} }},
+	{{ {1, 0}, {0, 1}, {1, 1}, {0, 2} }},
+
+	/* T-tetromino */
+	{{ {0, 0}, {1, 0}, {2, 0}, {1, 1} }},
+	{{ {1, 0}, {0, 1}, {1, 1}, {1, 2} }},
+	{{ {1, 0}, {0, 1}, {1, 1}, {2, 1} }},
+	{{ {0, 0}, {0, 1}, {1, 1}, {0, 2} }},
+
+	/* J-tetromino */
+	{{ {1, 0}, {1, 1}, {0, 2}, {1, 2} }},
+	{{ {0, 0}, {0, 1}, {1, 1}, {2, 1} }},
+	{{ {0, 0}, {1, 0}, {0, 1}, {0, 2} }},
+	{{ {0, 0}, {1, 0}, {2, 0}, {2, 1} }},
+
+	/* L-tetromino */
+	{{ {0, 0}, {0, 1}, {0, 2}, {1, 2} }},
+	{{ {0, 0}, {1, 0}, {2, 0}, {0, 1} }},
+	{{ {0, 0}, {1, 0}, {1, 1}, {1, 2} }},
+	{{ {2, 0}, {0, 1}, {1, 1}, {2, 1} }}
+};
@@ -0,0 +1,25 @@
+#ifndef SENTRY_H_TETROMINO
+#define SENTRY_H_TETROMINO
+
+/* The blocks of every tetromino: 7 kinds of 4 orientations each, which is
+ * kind * 4 + orientation and a rotation goes to the next orientation. The
+ * tables the engine looks up are generated from these at build time by
+ * gen_tables.
+ */
+
+enum { tetromino_count = 28 };
+
+struct block_t {
+	int x, y;
+};
+
+struct tetromino_t {
+	struct block_t blocks[4];
+};
+
+extern const struct tetromino_t tetromines[tetromino_count];
+
+/* 0..6: O, I, S, Z, T, J, L */
+#define piece_kind(which) ((which) / 4)
+
+#endif
@@ -0,0 +1,318 @@
+#include <stdio.h> /* sprintf */
+#include "engine.h"
+#include "piece_tables.h"
+#include "render.h"
+#include "view.h"
+
+enum { frame_width = 9, frame_height = 5 };
+
+/* the help is left of the board, the next piece and the score right of it */
+enum { side_width = 26, min_rows = 14 };
+
+enum { w_game_over = 58, h_game_over = 5 };
+
+static const char *game_over_logo[5] = {
+"   ____                            ___                    ",
+"  / ___|  __ _  _ __ ___    ___   / _ \\ __   __ ___  _ __ ",
+" | |  _  / _` || '_ ` _ \\  / _ \\ | | | |\\ \\ / // _ \\| '__|",
+" | |_| || (_| || | | | | ||  __/ | |_| | \\ V /|  __/| |   ",
+"  \\____| \\__,_||_| |_| |_| \\___|  \\___/   \\_/  \\___||_|   " };
+
+/* the box of the next piece, one string per row */
+#if FOR_WINDOWS
+static const char *const frame_rows[frame_height+1] = {
+	"*--------*",
+	"|        |",
+	"|        |",
+	"|        |",
+	"|        |",
+	"*--------*"
+};
+#else
+static const char *const frame_rows[frame_height+1] = {
+	"┌────────┐",
+	"│        │",
+	"│        │",
+	"│        │",
+	"│        │",
+	"└────────┘"
+};
+#endif
+
+static void print_tetromino_frame(struct view_t *v, const struct piece_t *p,
+								  int back_color)
+{
+	int i, w = p->which;
+	int offset_x = piece_preview_x[w]*2, offset_y = piece_preview_y[w];
+
+	for (i = 0; i < 4; i++)
+		render_text(&v->screen,
+					tetromines[w].blocks[i].x*2 + v->frame.x+1+offset_x,
+					tetromines[w].blocks[i].y + v->frame.y+1+offset_y,
+					"  ", default_font, back_color);
+}
+
+static void print_frame(struct view_t *v)
+{
+	int i;
+
+	/* 4 is "Next" */
+	render_text(&v->screen, v->frame.x + ((frame_width-4)/2+1), v->frame.y-1,
+				"Next", v->frame.font_color, default_back);
+
+	for (i = 0; i <= frame_height; i++)
+		render_text(&v->screen, v->frame.x, v->frame.y+i, frame_rows[i],
+					v->frame.font_color, default_back);
+}
+
+static void print_score(struct view_t *v)
+{
+	char buf[32];
+
+	sprintf(buf, "Score: %-8d", v->game->score);
+	render_text(&v->screen, v->score.x, v->score.y, buf, v->score.font_color,
+				default_back);
+}
+
+static void print_help(struct view_t *v)
+{
+	static const char *help[] = {
+		"L-arrow or a: left",
+		"R-arrow or d: right",
+		"D-arrow or s: down",
+		"w: hard drop",
+		"U-arrow or r: rotate",
+		"Esc or q: quit",
+		"Space: pause"
+	};
+	int i;
+
+	for (i = 0; i < (int)(sizeof(help) / sizeof(help[0])); i++)
+		render_text(&v->screen, v->map.x-25, v->map.y+i, help[i],
+					default_font, default_back);
+}
+
+static void print_pause(struct view_t *v, int paused)
+{
+	render_text(&v->screen, v->map.x-5, v->map.y-2, paused ?
+				"game is paused, press space to continue" :
+				"                                       ",
+				default_font, default_back);
+}
+
+static void print_map(struct view_t *v)
+{
+	int y;
+
+	render_clear(&v->screen);
+	for (y = v->map.y; y <= v->map.max_y; y++)
+		render_text(&v->screen, v->map.x, y, v->map_row, v->map.font_color,
+					default_back);
+}
+
+static void print_too_small(struct view_t *v)
+{
+	char buf[64];
+	int width, height;
+
+	view_min_size(v->game->width, v->game->height, &width, &height);
+	sprintf(buf, "increase the window size to %dx%d", width, height);
+	render_clear(&v->screen);
+	render_text(&v->screen, 1, 1, buf, default_font, default_back);
+}
+
+static void draw_tetromino(struct view_t *v, const struct piece_t *p,
+						   const char *s, int fg, int bg)
+{
+	int i, w = p->which;
+
+	for (i = 0; i < 4; i++)
+		render_text(&v->screen,
+					tetromines[w].blocks[i].x*2 + p->x*2 + v->map.x+1,
+					tetromines[w].blocks[i].y + p->y + v->map.y, s, fg, bg);
+}
+
+static void clean_tetromino(struct view_t *v, const struct piece_t *p)
+{
+	draw_tetromino(v, p, "..", v->map.font_color, default_back);
+}
+
+static void print_tetromino(struct view_t *v, const struct piece_t *p)
+{
+	draw_tetromino(v, p, "  ", default_font, back_red + piece_kind(p->which));
+}
+
+/* where the current tetromino would land */
+static void print_ghost(struct view_t *v, const struct piece_t *p)
+{
+	draw_tetromino(v, p, "[]", font_red + piece_kind(p->which), default_back);
+}
+
+static void print_piece(struct view_t *v)
+{
+	struct piece_t ghost = v->game->curr;
+
+	ghost.y += engine_drop_distance(v->game, &ghost);
+	print_ghost(v, &ghost);
+	print_tetromino(v, &v->game->curr);
+}
+
+static void print_grid(struct view_t *v)
+{
+	int x, y;
+
+	for (y = 0; y < v->game->height; y++) {
+		for (x = 0; x < v->game->width; x++) {
+			if (engine_color(v->game, x, y))
+				render_text(&v->screen, x*2 + v->map.x+1, y + v->map.y, "  ",
+							default_font,
+							back_red + engine_color(v->game, x, y)-1);
+			else
+				render_text(&v->screen, x*2 + v->map.x+1, y + v->map.y, "..",
+							v->map.font_color, default_back);
+		}
+	}
+}
+
+void view_min_size(int columns, int rows, int *width, int *height)
+{
+	*width = columns*2+2 + 2*side_width;
+	*height = rows + 4 < min_rows ? min_rows : rows + 4;
+}
+
+/* centers everything in a terminal of width x height */
+static void layout(struct view_t *v, int width, int height)
+{
+	int offset_x, offset_y, field_width = v->game->width*2,
+		field_height = v->game->height, min_width, min_height;
+
+	view_min_size(v->game->width, v->game->height, &min_width, &min_height);
+	v->fits = width >= min_width && height >= min_height;
+
+	/* offset_x + field_width+2 + offset_x */
+	offset_x = (width - (field_width+2))/2;
+	v->map.x = offset_x + 1;
+	v->map.max_x = offset_x + field_width+2;
+
+	/* offset_y + field_height + offset_y */
+	offset_y = (height - field_height)/2;
+	v->map.y = offset_y + 1;
+	v->map.max_y = offset_y + field_height;
+
+	v->map.font_color = font_white;
+
+	v->frame.x = v->map.max_x + 2;
+	v->frame.y = v->map.y+1; /* +1 for "Next" text */
+	v->frame.font_color = font_purple;
+
+	v->score.x = v->frame.x;
+	v->score.y = v->frame.y + frame_height + 2;
+	v->score.font_color = font_red;
+}
+
+int view_init(struct view_t *v, struct engine_t *game, int fd,
+			  int width, int height)
+{
+	int x;
+
+	v->game = game;
+	v->paused = 0;
+	if (!render_init(&v->screen, fd, width, height))
+		return 0;
+
+	v->map_row[0] = '|';
+	for (x = 1; x <= game->width*2; x++)
+		v->map_row[x] = '.';
+	v->map_row[x] = '|';
+	v->map_row[x+1] = 0;
+
+	layout(v, width, height);
+	view_draw(v);
+	return 1;
+}
+
+int view_resize(struct view_t *v, int width, int height)
+{
+	if (!render_resize(&v->screen, width, height))
+		return 0;
+
+	layout(v, width, height);
+	view_draw(v);
+	return 1;
+}
+
+void view_free(struct view_t *v)
+{
+	render_free(&v->screen);
+}
+
+void view_draw(struct view_t *v)
+{
+	if (!v->fits) {
+		print_too_small(v);
+		return;
+	}
+
+	print_map(v);
+	print_grid(v);
+	if (!v->game->game_over)
+		print_piece(v);
+	print_frame(v);
+	print_tetromino_frame(v, &v->game->next,
+						  back_red + piece_kind(v->game->next.which));
+	print_score(v);
+	print_help(v);
+	if (v->paused)
+		print_pause(v, 1);
+}
+
+void view_pause(struct view_t *v, int paused)
+{
+	v->paused = paused;
+	if (v->fits)
+		print_pause(v, paused);
+}
+
+void view_game_over(struct view_t *v)
+{
+	int i, x, y;
+
+	x = ((v->screen.width - w_game_over) / 2) + 1;
+	y = ((v->screen.height - h_game_over) / 2) + 1;
+
+	render_clear(&v->screen);
+	for (i = 0; i < h_game_over; i++)
+		render_text(&v->screen, x, y+i, game_over_logo[i],
+					default_font, default_back);
+}
+
+/* feed one input to the engine and redraw whatever it changed */
+int view_input(struct view_t *v, enum engine_input in)
+{
+	struct piece_t curr = v->game->curr, next = v->game->next;
+	struct piece_t ghost = v->game->curr;
+	int res;
+
+	/* nothing is on the screen to update, view_resize() draws it all */
+	if (!v->fits)
+		return engine_step(v->game, in);
+
+	ghost.y += engine_drop_distance(v->game, &ghost);
+	res = engine_step(v->game, in);
+	if (res & step_locked) {
+		print_grid(v);
+		print_score(v);
+		print_tetromino_frame(v, &next, default_back);
+		print_tetromino_frame(v, &v->game->next,
+							  back_red + piece_kind(v->game->next.which));
+		if (!(res & step_game_over))
+			print_piece(v);
+	} else if (res & step_moved) {
+		clean_tetromino(v, &ghost);
+		clean_tetromino(v, &curr);
+		print_piece(v);
+	}
+
+	return res;
+}
+
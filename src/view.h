@@ -0,0 +1,60 @@
+#ifndef SENTRY_H_VIEW
+#define SENTRY_H_VIEW
+
+#include "engine.h"
+#include "render.h"
+
+/* The screen of one game: the board with the falling piece and where it
+ * lands, the next piece, the score and the help, centered in a terminal of
+ * the size given to view_init() or view_resize(). The view draws into its
+ * renderer, the caller decides when to render_flush() it.
+ */
+
+struct map_t {
+	int x, y;
+	int max_x, max_y;
+	int font_color;
+};
+
+struct score_t {
+	int x, y;
+	int font_color;
+};
+
+struct frame_t {
+	int x, y;
+	int font_color;
+};
+
+struct view_t {
+	struct engine_t *game;
+	struct render_t screen;
+	struct map_t map;
+	struct frame_t frame;
+	struct score_t score;
+	int fits;			/* the terminal is at least view_min_size() */
+	int paused;
+	/* a row of the empty board, drawn with one render_text() */
+	char map_row[board_max_width*2 + 3];
+};
+
+/* the smallest terminal a board of columns x rows fits in with all around
+ * it
+ */
+void view_min_size(int columns, int rows, int *width, int *height);
+/* draws the whole game, returns 0 when out of memory */
+int view_init(struct view_t *v, struct engine_t *game, int fd,
+			  int width, int height);
+void view_free(struct view_t *v);
+/* lays the game out again for a terminal of another size and draws it, or
+ * only asks for a larger window if it does not fit; returns 0 when out of
+ * memory
+ */
+int view_resize(struct view_t *v, int width, int height);
+void view_draw(struct view_t *v);
+/* engine_step() plus drawing what it changed, returns its flags */
+int view_input(struct view_t *v, enum engine_input in);
+void view_pause(struct view_t *v, int paused);
+void view_game_over(struct view_t *v);
+
+#endif